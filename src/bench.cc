@@ -45,12 +45,34 @@ extern "C" {
 
 // static const
 static const size_t BUFFER_SIZE = 1 << 16;
+static const size_t PREDICT_NUM = 10; // completions per prefix
 // typedef
+#ifdef USE_COLOCATED_NINFO // node layout; compare insert and predict speed with a build without it
+#define CEDAR_LAYOUT " w/ colocated ninfo"
+#else
+#define CEDAR_LAYOUT ""
+#endif
 #if   defined (USE_CEDAR_UNORDERED)
 typedef cedar::da <int, -1, -2, false>              cedar_t;
 #else
 typedef cedar::da <int>                             cedar_t;
 #endif
+struct cedar_sorted_t { // cedar w/ sorted bulk upsert and lookup
+  cedar_t                  t;
+  cedar_t::sorted_updater  u;
+  cedar_t::sorted_searcher s;
+  cedar_sorted_t () : t (), u (t), s (t) {}
+};
+template <bool REMAP>
+struct cedar_label_t { // cedar w/ or w/o frequency-based label map; counts node moves
+  cedar_t t;
+  size_t  moves;
+  cedar_label_t () : t (), moves (0) {}
+  struct counter {
+    size_t* moves;
+    template <typename N> void operator () (const N, const N) { ++*moves; }
+  };
+};
 typedef Trie                                        Trie_t;
 typedef dutil::trie                                 trie_t;
 typedef Doar::DoubleArray                           doar_t;
@@ -218,6 +240,29 @@ template <>
 inline bool lookup_key <cedar_t> (cedar_t* t, const char* key, size_t len)
 { return t->exactMatchSearch <int> (key, len) >= 0; }
 
+// cedar w/ sorted bulk upsert and lookup; compare with cedar on sorted key/query files
+template <>
+inline void insert_key <cedar_sorted_t> (cedar_sorted_t* t, const char* key, size_t len, int n)
+{ t->u.update (key, len) = n; }
+template <>
+inline bool lookup_key <cedar_sorted_t> (cedar_sorted_t* t, const char* key, size_t len)
+{ return t->s.exactMatchSearch <int> (key, len) >= 0; }
+
+template <bool REMAP>
+inline void insert_key (cedar_label_t <REMAP>* t, const char* key, size_t len, int n) {
+#ifdef USE_PREFIX_TRIE
+  cedar::npos_t from (0);
+#else
+  size_t from (0);
+#endif
+  size_t pos (0);
+  typename cedar_label_t <REMAP>::counter cf = { &t->moves };
+  t->t.update (key, from, pos, len, 0, cf) = n;
+}
+template <bool REMAP>
+inline bool lookup_key (cedar_label_t <REMAP>* t, const char* key, size_t len)
+{ return t->t.template exactMatchSearch <int> (key, len) >= 0; }
+
 // libdatrie
 template <>
 inline void insert_key <Trie_t> (Trie_t* t, const char* key, size_t len, int n) {
@@ -336,6 +381,47 @@ template <>
 inline bool lookup_key <hat_t> (hat_t* t, const char* key, size_t len)
 { return hattrie_tryget (t, key, len); }
 
+// cedar w/ label map; the map is computed from the key file before insertion
+template <typename T>
+inline void prepare (T* t, const char* keys) {}
+template <>
+inline void prepare <cedar_label_t <true> > (cedar_label_t <true>* t, const char* keys) {
+  char* data = 0;
+  const size_t size = read_data (keys, data);
+  std::vector <const char*> key;
+  std::vector <size_t> len;
+  for (char* start (data), *end (data), *tail (data + size); end != tail; start = ++end) {
+    while (end != tail && *end != KEY_SEP) ++end;
+    key.push_back (start);
+    len.push_back (static_cast <size_t> (end - start));
+    if (end == tail) break;
+  }
+  t->t.set_label_map (key.size (), &key[0], &len[0]);
+  delete [] data;
+}
+template <typename T>
+inline void report (T* t) {}
+template <bool REMAP>
+inline void report (cedar_label_t <REMAP>* t) {
+  std::fprintf (stderr, "%-20s %.2f MiB (%ld nodes)\n", "Trie size:",
+                t->t.total_size () / 1048576.0, static_cast <long> (t->t.size ()));
+  std::fprintf (stderr, "%-20s %ld\n\n", "Node moves:", static_cast <long> (t->moves));
+}
+
+// clone; bulk copy of the arrays compared with the insertion time above
+template <typename T>
+inline void clone (T* t) {}
+template <>
+inline void clone <cedar_t> (cedar_t* t) {
+  struct timeval st, et;
+  ::gettimeofday (&st, NULL);
+  cedar_t c = t->clone ();
+  ::gettimeofday (&et, NULL);
+  double elapsed = (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n\n",
+                "Time to clone:", elapsed, elapsed * 1e9 / static_cast <double> (c.num_keys ()));
+}
+
 template <typename T>
 void insert (T* t, int fd, int& n) {
   char data[BUFFER_SIZE];
@@ -360,6 +446,39 @@ void lookup (T* t, char* data, size_t size, int& n_, int& n) {
   }
 }
 
+// predict; the first PREDICT_NUM keys that complete the first half of each query
+template <typename T>
+inline void predict (T* t, char* data, size_t size) {}
+template <>
+inline void predict <cedar_t> (cedar_t* t, char* data, size_t size) {
+#ifdef USE_PREFIX_TRIE
+  typedef cedar::npos_t npos_t;
+#else
+  typedef size_t npos_t;
+#endif
+  size_t n (0), n_ (0);
+  struct timeval st, et;
+  ::gettimeofday (&st, NULL);
+  for (char* start (data), *end (data), *tail (data + size); end != tail; start = ++end) {
+    while (end != tail && *end != '\0' && *end != KEY_SEP) ++end; // lookup () may have cut the keys
+    npos_t from (0);
+    size_t pos (0), len (0), k (0);
+    if (t->traverse (start, from, pos, static_cast <size_t> (end - start + 1) / 2) != cedar_t::CEDAR_NO_PATH) {
+      const npos_t root = from;
+      for (long r = t->begin (from, len); r != cedar_t::CEDAR_NO_PATH && k < PREDICT_NUM; r = t->next (from, len, root))
+        ++k;
+    }
+    n_ += k;
+    ++n;
+    if (end == tail) break;
+  }
+  ::gettimeofday (&et, NULL);
+  double elapsed = (et.tv_sec - st.tv_sec) + (et.tv_usec - st.tv_usec) * 1e-6;
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per key)\n",
+                "Time to predict:", elapsed, elapsed * 1e9 / n);
+  std::fprintf (stderr, "%-20s %ld\n", "Predicted:", static_cast <long> (n_));
+}
+
 template <typename T>
 void bench (const char* keys, const char* queries, const char* label) {
   size_t rss = get_process_size ();
@@ -368,6 +487,7 @@ void bench (const char* keys, const char* queries, const char* label) {
                 "Init RSS:", rss / 1048576.0, rss);
   //
   T* t = create <T> ();
+  prepare (t, keys);
   struct timeval st, et;
   {
     int fd = ::open (keys, O_RDONLY);
@@ -383,6 +503,8 @@ void bench (const char* keys, const char* queries, const char* label) {
                   "Time to insert:", elapsed, elapsed * 1e9 / n);
     std::fprintf (stderr, "%-20s %d\n\n", "Words:", n);
     ::close (fd);
+    report (t);
+    clone (t);
   }
   if (std::strcmp (queries, "-") != 0) {
     // load data
@@ -398,6 +520,7 @@ void bench (const char* keys, const char* queries, const char* label) {
                   "Time to search:", elapsed, elapsed * 1e9 / n);
     std::fprintf (stderr, "%-20s %d\n", "Words:", n);
     std::fprintf (stderr, "%-20s %d\n", "Found:", n_);
+    predict (t, data, size);
     delete [] data;
   }
   destroy (t);
@@ -409,11 +532,11 @@ int main (int argc, char** argv) {
   //
 #ifdef USE_CEDAR
 #if   defined (USE_PREFIX_TRIE)
-  bench <cedar_t>   (argv[1], argv[2], "cedar (prefix)");
+  bench <cedar_t>   (argv[1], argv[2], "cedar (prefix)" CEDAR_LAYOUT);
 #elif defined (USE_REDUCED_TRIE)
-  bench <cedar_t>   (argv[1], argv[2], "cedar (reduced)");
+  bench <cedar_t>   (argv[1], argv[2], "cedar (reduced)" CEDAR_LAYOUT);
 #else
-  bench <cedar_t>   (argv[1], argv[2], "cedar");
+  bench <cedar_t>   (argv[1], argv[2], "cedar" CEDAR_LAYOUT);
 #endif
 #endif
 #ifdef USE_CEDAR_UNORDERED
@@ -425,6 +548,27 @@ int main (int argc, char** argv) {
   bench <cedar_t>   (argv[1], argv[2], "cedar unordered");
 #endif
 #endif
+#ifdef USE_CEDAR_SORTED
+#if   defined (USE_PREFIX_TRIE)
+  bench <cedar_sorted_t> (argv[1], argv[2], "cedar sorted (prefix)");
+#elif defined (USE_REDUCED_TRIE)
+  bench <cedar_sorted_t> (argv[1], argv[2], "cedar sorted (reduced)");
+#else
+  bench <cedar_sorted_t> (argv[1], argv[2], "cedar sorted");
+#endif
+#endif
+#ifdef USE_CEDAR_REMAP
+#if   defined (USE_PREFIX_TRIE)
+  bench <cedar_label_t <false> > (argv[1], argv[2], "cedar w/o label map (prefix)");
+  bench <cedar_label_t <true> >  (argv[1], argv[2], "cedar w/ label map (prefix)");
+#elif defined (USE_REDUCED_TRIE)
+  bench <cedar_label_t <false> > (argv[1], argv[2], "cedar w/o label map (reduced)");
+  bench <cedar_label_t <true> >  (argv[1], argv[2], "cedar w/ label map (reduced)");
+#else
+  bench <cedar_label_t <false> > (argv[1], argv[2], "cedar w/o label map");
+  bench <cedar_label_t <true> >  (argv[1], argv[2], "cedar w/ label map");
+#endif
+#endif
 #ifdef USE_LIBDATRIE
   bench <Trie_t>    (argv[1], argv[2], "libdatrie");
 #endif
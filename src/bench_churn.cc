@@ -0,0 +1,92 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//  Benchmark of the tail of cedarpp.h under update/erase churn
+//
+//  Keeps a fixed number of random keys (a shared prefix and a random suffix of 8-64 bytes) while replacing
+//  one at random per step, and reports the tail as live, free (reusable by update ()) and lost bytes.
+//  Then erases most keys and adds new ones by merge () and sorted_updater, which may compact the tail
+//  halfway through a key, and exits with 1 if a key is lost.
+//  % bench_churn [keys] [steps]
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cedarpp.h>
+
+typedef cedar::da <int> cedar_t;
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ULL;
+static size_t rng (const size_t n) { // xorshift64*
+  rng_state ^= rng_state >> 12; rng_state ^= rng_state << 25; rng_state ^= rng_state >> 27;
+  return static_cast <size_t> ((rng_state * 2685821657736338717ULL) >> 33) % n;
+}
+
+static std::string random_key () {
+  static const char* prefix[] = { "http://example.com/", "http://example.org/a/", "https://www.example.net/" };
+  std::string key (prefix[rng (3)]);
+  for (size_t i = 0, n = 8 + rng (57); i < n; ++i)
+    key += static_cast <char> ('a' + rng (26));
+  return key;
+}
+
+static double elapsed (const timeval& st, const timeval& et)
+{ return static_cast <double> (et.tv_sec - st.tv_sec) + static_cast <double> (et.tv_usec - st.tv_usec) * 1e-6; }
+
+static void report (const cedar_t& da, const size_t step) {
+  const size_t live = da.nonzero_length (), free_ = da.free_length ();
+  std::fprintf (stderr, "%10ld steps: tail %10ld bytes (live %10ld, free %9ld, lost %9ld)\n",
+                step, da.length (), live, free_, da.length () - sizeof (int) - live - free_);
+}
+
+int main (int argc, char** argv) {
+  const size_t num_keys = argc > 1 ? static_cast <size_t> (std::strtoul (argv[1], NULL, 10)) : 100000;
+  const size_t steps    = argc > 2 ? static_cast <size_t> (std::strtoul (argv[2], NULL, 10)) : num_keys * 20;
+  cedar_t da;
+  std::vector <std::string> keys (num_keys);
+  for (size_t i = 0; i < num_keys; ++i) {
+    keys[i] = random_key ();
+    da.update (keys[i].c_str (), keys[i].size (), static_cast <int> (i));
+  }
+  report (da, 0);
+  struct timeval st, et;
+  ::gettimeofday (&st, NULL);
+  for (size_t step = 1; step <= steps; ++step) {
+    std::string& key = keys[rng (num_keys)];
+    da.erase (key.c_str (), key.size ());
+    key = random_key ();
+    da.update (key.c_str (), key.size (), static_cast <int> (step));
+    if (step % (steps / 10 ? steps / 10 : 1) == 0) report (da, step);
+  }
+  ::gettimeofday (&et, NULL);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per step)\n", "Churn:",
+                elapsed (st, et), elapsed (st, et) * 1e9 / static_cast <double> (steps));
+  size_t n = 0;
+  for (size_t i = 0; i < num_keys; ++i)
+    if (da.exactMatchSearch <int> (keys[i].c_str (), keys[i].size ()) != cedar_t::CEDAR_NO_VALUE) ++n;
+  std::fprintf (stderr, "%-20s %ld / %ld keys\n", "Found:", n, num_keys);
+  // leave dead bytes on tail so that the next update () compacts it
+  std::vector <std::string> added;
+  for (size_t i = 0; i < num_keys; ++i)
+    if (rng (4)) da.erase (keys[i].c_str (), keys[i].size ());
+    else added.push_back (keys[i]);
+  cedar_t t;
+  for (size_t i = 0; i < num_keys / 4 + 1; ++i) {
+    added.push_back (random_key ());
+    t.update (added.back ().c_str (), added.back ().size (), static_cast <int> (i));
+  }
+  da.merge (t, cedar_t::merge_overwrite ());
+  std::vector <std::string> sorted;
+  for (size_t i = 0; i < num_keys / 4 + 1; ++i) sorted.push_back (random_key ());
+  std::sort (sorted.begin (), sorted.end ());
+  cedar_t::sorted_updater u (da);
+  for (size_t i = 0; i < sorted.size (); ++i)
+    u.update (sorted[i].c_str (), sorted[i].size (), static_cast <int> (i));
+  added.insert (added.end (), sorted.begin (), sorted.end ());
+  n = 0;
+  for (size_t i = 0; i < added.size (); ++i)
+    if (da.exactMatchSearch <int> (added[i].c_str (), added[i].size ()) != cedar_t::CEDAR_NO_VALUE) ++n;
+  std::fprintf (stderr, "%-20s %ld / %ld keys (%ld counted, %ld by scan)\n", "Merged:", n, added.size (),
+                da.num_keys (), da.num_keys_by_scan ());
+  return n == added.size () && da.num_keys () == da.num_keys_by_scan () ? 0 : 1;
+}
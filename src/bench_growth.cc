@@ -0,0 +1,133 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//  Benchmark of the growth policies of cedar.h
+//
+//  Builds a trie of the keys (one per line in a file, or random URL-like keys) with each growth policy in a
+//  forked process and reports the build time, the peak RSS (also over that of a process that only holds the
+//  keys), the final capacity and the bytes of the array it leaves unused. The limit of set_max_alloc () for
+//  the limited policies defaults to 1.5 times the array of the nodes in use after the build. A policy of a user
+//  (growing by a quarter) is given for comparison.
+//  % bench_growth [keys|num_keys] [max_alloc_in_MB]
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cedar.h>
+
+struct quarter_growth { // grow by a quarter of the size, ignoring the memory limit
+  static long grow (const long size, const size_t, const size_t, const size_t)
+  { return size + ((size >> 10) << 8 > 256 ? (size >> 10) << 8 : 256); }
+};
+
+template <typename GROWTH>
+struct trie_t { typedef cedar::da <int, -1, -2, true, 1, false, GROWTH> type; };
+
+struct result {
+  double time;     // sec
+  long   rss;      // peak RSS in kB
+  size_t capacity; // nodes
+  size_t size;     // nodes
+  size_t unit;     // bytes per node
+};
+
+static double elapsed (const timeval& st, const timeval& et)
+{ return static_cast <double> (et.tv_sec - st.tv_sec) + static_cast <double> (et.tv_usec - st.tv_usec) * 1e-6; }
+
+template <typename GROWTH>
+static void build (const std::vector <std::string>& keys, const size_t max_alloc, result& r) {
+  struct timeval st, et;
+  ::gettimeofday (&st, NULL);
+  typename trie_t <GROWTH>::type da;
+  da.set_max_alloc (max_alloc);
+  for (size_t i = 0; i < keys.size (); ++i)
+    da.update (keys[i].c_str (), keys[i].size (), static_cast <int> (i));
+  ::gettimeofday (&et, NULL);
+  r.time = elapsed (st, et);
+  r.capacity = da.capacity ();
+  r.size = da.size ();
+  r.unit = da.unit_size ();
+}
+
+// run f in a child process and take its peak RSS
+template <typename F>
+static void run (F f, result& r) {
+  const pid_t pid = ::fork ();
+  if (pid < 0) { std::fprintf (stderr, "fork failed\n"); std::exit (1); }
+  if (pid == 0) { f (r); std::_Exit (0); }
+  int status = 0;
+  struct rusage ru;
+  if (::wait4 (pid, &status, 0, &ru) != pid || ! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    { std::fprintf (stderr, "child failed\n"); std::exit (1); }
+  r.rss = ru.ru_maxrss;
+}
+
+struct keys_only { void operator () (result& r) const { r.time = 0; r.capacity = r.size = r.unit = 0; } };
+template <typename GROWTH>
+struct builder {
+  const std::vector <std::string>* keys;
+  size_t max_alloc;
+  void operator () (result& r) const { build <GROWTH> (*keys, max_alloc, r); }
+};
+
+int main (int argc, char** argv) {
+  std::vector <std::string> keys;
+  if (argc > 1 && std::strspn (argv[1], "0123456789") != std::strlen (argv[1])) {
+    FILE* fp = std::fopen (argv[1], "r");
+    if (! fp) { std::fprintf (stderr, "no such file: %s\n", argv[1]); std::exit (1); }
+    char line[8192];
+    while (std::fgets (line, sizeof (line), fp)) {
+      size_t len = std::strlen (line);
+      if (len && line[len - 1] == '\n') line[--len] = '\0';
+      if (len) keys.push_back (std::string (line, len));
+    }
+    std::fclose (fp);
+  } else {
+    const size_t num_keys = argc > 1 ? static_cast <size_t> (std::strtoul (argv[1], NULL, 10)) : 1000000;
+    static const char* host[] = { "http://example.com/", "http://example.org/a/", "https://www.example.net/" };
+    unsigned long long s = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < num_keys; ++i) {
+      std::string key (host[i % 3]);
+      for (size_t j = 0, n = 8 + i % 24; j < n; ++j) {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        key += static_cast <char> ('a' + ((s * 2685821657736338717ULL) >> 33) % 26);
+      }
+      keys.push_back (key);
+    }
+  }
+  // results are written by the children
+  result* r = static_cast <result*> (::mmap (NULL, sizeof (result) * 6, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (r == MAP_FAILED) { std::fprintf (stderr, "mmap failed\n"); std::exit (1); }
+  run (keys_only (), r[0]);
+  builder <cedar::exact_fit_growth> exact_fit = { &keys, 0 };
+  run (exact_fit, r[1]);
+  size_t max_alloc = argc > 2 ? static_cast <size_t> (std::strtod (argv[2], NULL) * (1 << 20)) : 0;
+  if (! max_alloc)
+    max_alloc = r[1].size * r[1].unit * 3 / 2;
+  builder <cedar::doubling_growth> doubling = { &keys, 0 }, doubling_limited = { &keys, max_alloc };
+  builder <cedar::at_once_growth>  at_once = { &keys, max_alloc };
+  run (doubling,         r[2]);
+  run (doubling_limited, r[3]);
+  run (at_once,          r[4]);
+  builder <quarter_growth> quarter = { &keys, 0 };
+  run (quarter,          r[5]);
+  static const char* name[] = { "(keys only)", "exact_fit", "doubling", "doubling (limit)", "at_once (limit)",
+                                "quarter" };
+  std::fprintf (stderr, "%zu keys; limit %.2f MB\n", keys.size (), static_cast <double> (max_alloc) / (1 << 20));
+  std::fprintf (stderr, "%-18s %9s %10s %10s %12s %11s\n", "policy", "build (s)", "peak (MB)", "trie (MB)",
+                "capacity", "unused (MB)");
+  for (int i = 0; i < 6; ++i) {
+    const double rss = static_cast <double> (r[i].rss) / 1024;
+    if (! i) { std::fprintf (stderr, "%-18s %9s %10.2f\n", name[i], "-", rss); continue; }
+    std::fprintf (stderr, "%-18s %9.3f %10.2f %10.2f %12zu %11.2f\n", name[i], r[i].time, rss,
+                  rss - static_cast <double> (r[0].rss) / 1024, r[i].capacity,
+                  static_cast <double> ((r[i].capacity - r[i].size) * r[i].unit) / (1 << 20));
+  }
+  ::munmap (r, sizeof (result) * 6);
+  return 0;
+}
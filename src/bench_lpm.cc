@@ -0,0 +1,140 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//  Benchmark of cedar::lpm against per-length hash tables on a routing table
+//
+//  Input is one prefix per line (e.g., a BGP table dump: "1.0.4.0/22", "2001:db8::/32");
+//  anything after the prefix is ignored. Queries are random addresses within the prefixes.
+//  % bench_lpm prefixes [queries_per_prefix]
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#ifdef USE_PREFIX_TRIE
+#include <cedarpp.h>
+#else
+#include <cedar.h>
+#endif
+#include <cedar_lpm.h>
+
+static const size_t BUFFER_SIZE = 1 << 16;
+typedef cedar::da <int>      cedar_t;
+typedef cedar::lpm <cedar_t> lpm_t;
+
+struct prefix_t {
+  unsigned char addr[16];
+  size_t        len;
+};
+
+// naive LPM: one hash table per prefix length; probe from the longest length
+class hash_lpm {
+public:
+  explicit hash_lpm (const size_t bits) : _bits (bits), _table (bits + 1) {}
+  void insert (const unsigned char* prefix, const size_t len, const int value)
+  { _table[len][_key (prefix, len)] = value; }
+  int longestPrefixMatch (const unsigned char* addr) const {
+    for (size_t len = _bits + 1; len-- > 0; ) {
+      if (_table[len].empty ()) continue;
+      std::unordered_map <std::string, int>::const_iterator it = _table[len].find (_key (addr, len));
+      if (it != _table[len].end ()) return it->second;
+    }
+    return -1;
+  }
+private:
+  size_t _bits;
+  std::vector <std::unordered_map <std::string, int> > _table;
+  static std::string _key (const unsigned char* addr, const size_t len) {
+    std::string key (reinterpret_cast <const char*> (addr), (len + 7) / 8);
+    if (len % 8) key[len / 8] = static_cast <char> (key[len / 8] & (0xff00 >> (len % 8)));
+    return key;
+  }
+};
+
+static void mask (unsigned char* addr, const size_t len) {
+  for (size_t i = len; i < 128; ++i) addr[i / 8] = static_cast <unsigned char> (addr[i / 8] & ~(0x80 >> (i % 8)));
+}
+
+static double elapsed (const timeval& st, const timeval& et)
+{ return static_cast <double> (et.tv_sec - st.tv_sec) + static_cast <double> (et.tv_usec - st.tv_usec) * 1e-6; }
+
+static void bench (const char* label, const std::vector <prefix_t>& prefixes, const std::vector <prefix_t>& queries, const size_t bits) {
+  if (prefixes.empty ()) return;
+  lpm_t lpm;
+  hash_lpm naive (bits);
+  struct timeval st, et;
+  std::fprintf (stderr, "---- %-25s --------------------------\n", label);
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < prefixes.size (); ++i)
+    lpm.insert (prefixes[i].addr, prefixes[i].len, static_cast <int> (i));
+  ::gettimeofday (&et, NULL);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per prefix)\n", "Insert (cedar):",
+                elapsed (st, et), elapsed (st, et) * 1e9 / static_cast <double> (prefixes.size ()));
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < prefixes.size (); ++i)
+    naive.insert (prefixes[i].addr, prefixes[i].len, static_cast <int> (i));
+  ::gettimeofday (&et, NULL);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per prefix)\n", "Insert (hash):",
+                elapsed (st, et), elapsed (st, et) * 1e9 / static_cast <double> (prefixes.size ()));
+  std::fprintf (stderr, "%-20s %.2f MiB (%ld bytes)\n", "Trie size:",
+                static_cast <double> (lpm.trie ().total_size ()) / (1 << 20), static_cast <long> (lpm.trie ().total_size ()));
+  std::vector <int> r0 (queries.size ()), r1 (queries.size ());
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < queries.size (); ++i)
+    r0[i] = lpm.longestPrefixMatch (queries[i].addr, bits);
+  ::gettimeofday (&et, NULL);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per query)\n", "Lookup (cedar):",
+                elapsed (st, et), elapsed (st, et) * 1e9 / static_cast <double> (queries.size ()));
+  ::gettimeofday (&st, NULL);
+  for (size_t i = 0; i < queries.size (); ++i)
+    r1[i] = naive.longestPrefixMatch (queries[i].addr);
+  ::gettimeofday (&et, NULL);
+  std::fprintf (stderr, "%-20s %.2f sec (%.2f nsec per query)\n", "Lookup (hash):",
+                elapsed (st, et), elapsed (st, et) * 1e9 / static_cast <double> (queries.size ()));
+  // values are the last index of a duplicated prefix in both
+  size_t n = 0;
+  for (size_t i = 0; i < queries.size (); ++i)
+    if (r0[i] != r1[i]) ++n;
+  std::fprintf (stderr, "%-20s %ld\n%-20s %ld\n\n", "Queries:", static_cast <long> (queries.size ()), "Mismatches:", static_cast <long> (n));
+  if (n) std::exit (1);
+}
+
+int main (int argc, char** argv) {
+  if (argc < 2)
+    { std::fprintf (stderr, "Usage: %s prefixes [queries_per_prefix]\n", argv[0]); std::exit (1); }
+  const size_t per_prefix = argc > 2 ? static_cast <size_t> (std::strtoul (argv[2], NULL, 10)) : 4;
+  FILE* fp = std::fopen (argv[1], "r");
+  if (! fp)
+    { std::fprintf (stderr, "no such file: %s\n", argv[1]); std::exit (1); }
+  std::vector <prefix_t> prefixes[2], queries[2]; // IPv4, IPv6
+  char line[BUFFER_SIZE];
+  while (std::fgets (line, static_cast <int> (BUFFER_SIZE), fp)) {
+    char* p = line + std::strspn (line, " \t");
+    char* slash = std::strchr (p, '/');
+    if (! slash) continue;
+    *slash = '\0';
+    prefix_t r;
+    std::memset (r.addr, 0, sizeof (r.addr));
+    const int v6 = std::strchr (p, ':') != NULL;
+    if (::inet_pton (v6 ? AF_INET6 : AF_INET, p, r.addr) != 1) continue;
+    char* end = 0;
+    r.len = static_cast <size_t> (std::strtoul (slash + 1, &end, 10));
+    if (end == slash + 1 || r.len > (v6 ? 128 : 32)) continue;
+    mask (r.addr, r.len);
+    prefixes[v6].push_back (r);
+  }
+  std::fclose (fp);
+  std::srand (0);
+  for (int v6 = 0; v6 < 2; ++v6)
+    for (size_t i = 0; i < prefixes[v6].size (); ++i)
+      for (size_t j = 0; j < per_prefix; ++j) {
+        prefix_t q = prefixes[v6][i];
+        for (size_t k = q.len; k < (v6 ? 128 : 32); ++k)
+          if (std::rand () & 1) q.addr[k / 8] = static_cast <unsigned char> (q.addr[k / 8] | (0x80 >> (k % 8)));
+        queries[v6].push_back (q);
+      }
+  bench ("cedar::lpm (IPv4)", prefixes[0], queries[0], 32);
+  bench ("cedar::lpm (IPv6)", prefixes[1], queries[1], 128);
+  return 0;
+}
@@ -0,0 +1,172 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//  Stress test and benchmark of cedar::publisher (hot-swap publication of rebuilt tries)
+//
+//  Reader threads look up random keys while the writer rebuilds the trie and publishes each
+//  generation, alternately built in memory and mapped from a saved file. All the keys of
+//  generation g have value g, as does a marker key, so a reader must see one value for every
+//  lookup within an acquire (), and generations must never go backwards; anything else is
+//  counted as torn and makes the exit status non-zero.
+//  % bench_publish keys [readers [generations]]
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <atomic>
+#include <thread>
+#ifdef USE_PREFIX_TRIE
+#include <cedarpp.h>
+#else
+#include <cedar.h>
+#endif
+#include <cedar_publish.h>
+
+static const size_t BUFFER_SIZE = 1 << 16;
+static const size_t BATCH = 16; // lookups per acquire ()
+static const char   MARKER[] = "\x01";
+typedef cedar::da <int>            cedar_t;
+typedef cedar::publisher <cedar_t> publisher_t;
+
+struct stat_t {
+  size_t lookups;
+  size_t acquires;
+  size_t torn;
+  stat_t () : lookups (0), acquires (0), torn (0) {}
+};
+
+static double elapsed (const timeval& st, const timeval& et)
+{ return static_cast <double> (et.tv_sec - st.tv_sec) + static_cast <double> (et.tv_usec - st.tv_usec) * 1e-6; }
+
+static inline size_t xorshift (uint64_t& x) { x ^= x << 13; x ^= x >> 7; x ^= x << 17; return static_cast <size_t> (x); }
+
+static cedar_t* build (const std::vector <std::string>& keys, const int g) {
+  cedar_t* t = new cedar_t;
+  for (size_t i = 0; i < keys.size (); ++i)
+    t->update (keys[i].c_str (), keys[i].size ()) = g;
+  t->update (MARKER, 1) = g;
+  return t;
+}
+
+static void read_loop (publisher_t* pub, const std::vector <std::string>* keys, const std::atomic <bool>* stop, stat_t* s, const uint64_t seed) {
+  publisher_t::reader r (*pub);
+  uint64_t x = seed;
+  int last = 0;
+  while (! stop->load (std::memory_order_relaxed)) {
+    publisher_t::guard g (r);
+    const int gen = g->exactMatchSearch <int> (MARKER, 1);
+    if (gen < last || g->num_keys () != keys->size () + 1) ++s->torn;
+    last = gen;
+    for (size_t i = 0; i < BATCH; ++i) {
+      const std::string& key = (*keys)[xorshift (x) % keys->size ()];
+      if (g->exactMatchSearch <int> (key.c_str (), key.size ()) != gen) ++s->torn;
+    }
+    s->lookups += BATCH + 1;
+    ++s->acquires;
+  }
+}
+
+int main (int argc, char** argv) {
+  if (argc < 2)
+    { std::fprintf (stderr, "Usage: %s keys [readers [generations]]\n", argv[0]); std::exit (1); }
+  const size_t num_readers = argc > 2 ? static_cast <size_t> (std::strtoul (argv[2], NULL, 10)) : 2;
+  const int    num_gen     = argc > 3 ? std::atoi (argv[3]) : 20;
+  std::vector <std::string> keys;
+  {
+    FILE* fp = std::fopen (argv[1], "r");
+    if (! fp) { std::fprintf (stderr, "no such file: %s\n", argv[1]); std::exit (1); }
+    char line[BUFFER_SIZE];
+    while (std::fgets (line, static_cast <int> (BUFFER_SIZE), fp)) {
+      size_t len = std::strlen (line);
+      while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) --len;
+      if (len) keys.push_back (std::string (line, len));
+    }
+    std::fclose (fp);
+  }
+  if (keys.empty ()) { std::fprintf (stderr, "no keys: %s\n", argv[1]); std::exit (1); }
+  std::sort (keys.begin (), keys.end ()); // so that num_keys () is known
+  keys.erase (std::unique (keys.begin (), keys.end ()), keys.end ());
+  keys.erase (std::remove (keys.begin (), keys.end (), std::string (MARKER)), keys.end ());
+  const std::string fn = std::string (argv[1]) + ".publish";
+  const std::string tmp = fn + ".tmp";
+  publisher_t pub (num_readers + 1);
+  pub.publish (build (keys, 1));
+  std::atomic <bool> stop (false);
+  std::vector <stat_t> stat (num_readers);
+  std::vector <std::thread> reader;
+  for (size_t i = 0; i < num_readers; ++i)
+    reader.push_back (std::thread (read_loop, &pub, &keys, &stop, &stat[i], 88172645463325252ULL + i));
+  struct timeval st, et, st_, et_;
+  double build_time (0), publish_time (0);
+  size_t max_retired (0);
+  ::gettimeofday (&st_, NULL);
+  for (int g = 2; g <= num_gen; ++g) {
+    ::gettimeofday (&st, NULL);
+    cedar_t* t = build (keys, g);
+    const bool mapped = g % 2;
+    if (mapped) { // replace the file by rename (); the old mapping stays valid
+      if (t->save (tmp.c_str ()) != 0 || std::rename ((tmp + ".hdr").c_str (), (fn + ".hdr").c_str ()) != 0 ||
+          std::rename (tmp.c_str (), fn.c_str ()) != 0)
+        { std::fprintf (stderr, "cannot save: %s\n", fn.c_str ()); std::exit (1); }
+      delete t;
+    }
+    ::gettimeofday (&et, NULL);
+    build_time += elapsed (st, et);
+    ::gettimeofday (&st, NULL);
+    if (mapped) {
+      if (pub.publish_mapped (fn.c_str ()) != 0)
+        { std::fprintf (stderr, "cannot map: %s\n", fn.c_str ()); std::exit (1); }
+    } else
+      pub.publish (t);
+    ::gettimeofday (&et, NULL);
+    publish_time += elapsed (st, et);
+    if (pub.retired () > max_retired) max_retired = pub.retired ();
+  }
+  ::gettimeofday (&et_, NULL);
+  stop.store (true);
+  for (size_t i = 0; i < num_readers; ++i) reader[i].join ();
+  pub.synchronize ();
+  std::remove (fn.c_str ());
+  std::remove ((fn + ".hdr").c_str ());
+  const double total = elapsed (st_, et_);
+  stat_t sum;
+  for (size_t i = 0; i < num_readers; ++i)
+    sum.lookups += stat[i].lookups, sum.acquires += stat[i].acquires, sum.torn += stat[i].torn;
+  std::fprintf (stderr, "%-20s %ld (%d generations, %ld readers)\n", "Keys:",
+                static_cast <long> (keys.size ()), num_gen, static_cast <long> (num_readers));
+  std::fprintf (stderr, "%-20s %.2f sec per generation\n", "Time to build:", build_time / (num_gen - 1));
+  std::fprintf (stderr, "%-20s %.2f usec per generation\n", "Time to publish:", publish_time * 1e6 / (num_gen - 1));
+  std::fprintf (stderr, "%-20s %ld\n", "Max retired:", static_cast <long> (max_retired));
+  std::fprintf (stderr, "%-20s %.2f M/sec (%ld acquires)\n", "Lookups:",
+                static_cast <double> (sum.lookups) / total * 1e-6, static_cast <long> (sum.acquires));
+  std::fprintf (stderr, "%-20s %ld\n\n", "Torn:", static_cast <long> (sum.torn));
+  { // cost of acquire () on a quiet publisher
+    publisher_t::reader r (pub);
+    const size_t n = 1 << 22;
+    uint64_t x = 88172645463325252ULL;
+    size_t found (0);
+    for (int batch = 1; batch <= 2; ++batch) {
+      ::gettimeofday (&st, NULL);
+      if (batch == 1) {
+        for (size_t i = 0; i < n; ++i) {
+          publisher_t::guard g (r);
+          const std::string& key = keys[xorshift (x) % keys.size ()];
+          found += g->exactMatchSearch <int> (key.c_str (), key.size ()) > 0;
+        }
+      } else {
+        publisher_t::guard g (r);
+        for (size_t i = 0; i < n; ++i) {
+          const std::string& key = keys[xorshift (x) % keys.size ()];
+          found += g->exactMatchSearch <int> (key.c_str (), key.size ()) > 0;
+        }
+      }
+      ::gettimeofday (&et, NULL);
+      std::fprintf (stderr, "%-20s %.2f nsec per lookup (found %ld)\n",
+                    batch == 1 ? "Acquire per lookup:" : "One acquire:",
+                    elapsed (st, et) * 1e9 / static_cast <double> (n), static_cast <long> (found));
+      found = 0;
+    }
+  }
+  return sum.torn ? 1 : 0;
+}
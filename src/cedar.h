@@ -3,18 +3,30 @@
 //
 //  Three trie implementations: a (normal) trie, a reduced trie [3] (compact size and faster look-up for short keys),
 //  a minimal-prefix trie (compact size for long keys).
-//  A reduced trie is enabled if you put #define USE_REDUCED_TRIE 1 before #include <cedar.h>,
-//  while a minimal-prefix trie is enabled if you #include <cedarpp.h> instead of cedar.h.
+//  A reduced trie is cedar::da if you put #define USE_REDUCED_TRIE 1 before #include <cedar.h>,
+//  while a minimal-prefix trie is cedar::da if you #include <cedarpp.h> instead of cedar.h.
+//  Regardless, cedar::trie, cedar::reduced_trie and (with cedarpp.h included after cedar.h) cedar::prefix_trie
+//  name the three, which can be used together; cedar_select.h picks one for a set of keys.
 //
 // Copyright (c) 2009-2014 Naoki Yoshinaga <ynaga@tkl.iis.u-tokyo.ac.jp>
 //
 #ifndef CEDAR_H
 #define CEDAR_H
+#ifdef CEDARPP_H
+#error "include cedar.h before cedarpp.h to use both; cedar::da is then the trie of cedar.h"
+#endif
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring> //std::strlen
 #include <cassert> //assert
+#include <cstddef> //std::ptrdiff_t
+#include <stdint.h> //uint64_t
+#include <iterator> //std::input_iterator_tag
+#include <utility> //std::swap
+#if defined (__AVX2__) && ! defined (USE_RING_FIND_PLACE)
+#include <immintrin.h> //_find_place () w/ AVX2
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -27,16 +39,61 @@ namespace cedar {
   template <> struct NaN <float> { enum { N1 = 0x7f800001, N2 = 0x7f800002 }; };  // 0x7f800001 == +INF +1 and 0x7f800002 == +INF +2
   static const long MAX_ALLOC_SIZE = 1L << 32; // must be divisible by 256 (1 << 16 == 65536 == 256*256, 1L << 32 == 4294967296 == 256*256*256*256 )
 
+  // growth policies of the double array; grow () returns the new capacity (a multiple of 256) of a full array of
+  // size nodes, or no more than size if the memory limit of set_max_alloc () (0 if unset) leaves no room.
+  // A node takes node_bytes and each block of 256 nodes block_bytes more.
+  struct doubling_growth { // double the capacity; near the limit, take what is left up to it
+    static long grow (const long size, const size_t max_alloc, const size_t node_bytes, const size_t block_bytes) {
+      if (! max_alloc) return size + size;
+      const long limit = max_capacity (max_alloc, node_bytes, block_bytes);
+      return size + size < limit ? size + size : limit;
+    }
+    // the largest capacity within max_alloc bytes
+    static long max_capacity (const size_t max_alloc, const size_t node_bytes, const size_t block_bytes)
+    { return static_cast <long> (max_alloc / ((node_bytes << 8) + block_bytes)) << 8; }
+  };
+  struct exact_fit_growth { // grow by the size, at most MAX_ALLOC_SIZE at a time; ignores the memory limit
+    static long grow (const long size, const size_t, const size_t, const size_t)
+    { return size + (size >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : size); }
+  };
+  struct at_once_growth { // take the whole memory limit, which must be set, at the first growth
+    static long grow (const long, const size_t max_alloc, const size_t node_bytes, const size_t block_bytes)
+    { return doubling_growth::max_capacity (max_alloc, node_bytes, block_bytes); }
+  };
+
   // dynamic double array
-  template <typename value_type,
-            const int     NO_VALUE  = NaN <value_type>::N1,
-            const int     NO_PATH   = NaN <value_type>::N2,
+  template <typename value_type_,
+            const int     NO_VALUE  = NaN <value_type_>::N1,
+            const int     NO_PATH   = NaN <value_type_>::N2,
             const bool    ORDERED   = true,
             const int     MAX_TRIAL = 1,
-            const size_t  NUM_TRACKING_NODES = 0>
+#ifdef USE_REDUCED_TRIE
+            const bool    REDUCED   = true,  // values are non-negative and stored in leaves
+#else
+            const bool    REDUCED   = false,
+#endif
+#if   defined (USE_EXACT_FIT)
+            typename      GROWTH    = exact_fit_growth,
+#elif defined (ALLOCATE_MEMORY_AT_ONCE)
+            typename      GROWTH    = at_once_growth,
+#else
+            typename      GROWTH    = doubling_growth,
+#endif
+#ifdef USE_FAST_LOAD
+            const bool    FAST_LOAD = true>  // save () and open () also keep ninfo and blocks in <file>.sbl
+#else
+            const bool    FAST_LOAD = false>
+#endif
   class da {
+  public:
+    typedef value_type_ value_type;
+  private:
       typedef long baseindex;  // XXX This type is associated with value_type maybe there is more!
+#ifdef USE_COLOCATED_NINFO
+      typedef int  checkindex; // leaves room for ninfo in node; < 2^31 nodes
+#else
       typedef long checkindex;
+#endif
       typedef long size_type;
       typedef long blockindex;
       typedef union { baseindex i; value_type x; } nodeelement;
@@ -44,6 +101,10 @@ namespace cedar {
     enum error_code { CEDAR_NO_VALUE = NO_VALUE, CEDAR_NO_PATH = NO_PATH, CEDAR_VALUE_LIMIT = 2147483647 };  // 2147483647 == 2^31 − 1
     //
     typedef value_type result_type;
+    struct payload_type { // view of a record in the payload store
+      const char* data; // 0 if not found
+      size_t      size;
+    };
     struct result_pair_type { // for prefix/suffix search
       value_type  value;
       size_t      length;  // prefix length
@@ -54,6 +115,18 @@ namespace cedar {
       size_t      length;  // suffix length
       size_t      id;      // node id of value
     };
+    /*
+     * ninfo == nlink in the paper
+     * For each node, ninfo stores the label needed to reach its first child
+     * and the label needed to reach the sibling nodes from its parent for realocation.
+     * With USE_COLOCATED_NINFO, it lives in the padding of each node instead of a separate array,
+     * so that the node and its ninfo are read by an update () from one cache line.
+    */
+    struct ninfo {  // x1.5 update speed; +.25 % memory (8n -> 10n)
+      uchar  sibling;   // right sibling (= 0 if not exist)
+      uchar  child;     // first child
+      ninfo () : sibling (0), child (0) {}
+    };
     /* varialbe base_ stores the offset address of its child, so a child node takes the address c = base_[p] ^ l
      * when the node is traveresed from p by label l.
      * For each node c, variable check stores the address of its parent node, p, and is used to confirm the validity of
@@ -71,23 +144,12 @@ namespace cedar {
       // Node element:
       union { baseindex base_; value_type value; }; // negative means prev empty index
       checkindex  check;                            // negative means next empty index
+#ifdef USE_COLOCATED_NINFO
+      ninfo       info;                             // in the padding after check; see _info ()
+#endif
       node (const baseindex base__ = 0, const checkindex check_ = 0)
         : base_ (base__), check (check_) {}
-#ifdef USE_REDUCED_TRIE
-      baseindex base () const { return - (base_ + 1); } // ~ in two's complement system
-#else
-      baseindex base () const { return base_; }
-#endif
-    };
-    /*
-     * ninfo == nlink in the paper
-     * For each node, ninfo stores the label needed to reach its first child
-     * and the label needed to reach the sibling nodes from its parent for realocation.
-    */
-    struct ninfo {  // x1.5 update speed; +.25 % memory (8n -> 10n)
-      uchar  sibling;   // right sibling (= 0 if not exist)
-      uchar  child;     // first child
-      ninfo () : sibling (0), child (0) {}
+      baseindex base () const { return REDUCED ? - (base_ + 1) : base_; } // ~ in two's complement system
     };
     /*
      * Variable _block stores information on empty addresses within each 256 conescutive addresses called block in base_ and check
@@ -101,6 +163,9 @@ namespace cedar {
      * To support deletion we register each block empty addresses resulting from deletion.
      * A new key will be stored immediately after the deletion.
      * The trie is not packed after deletion.
+     *
+     * Each block also keeps a bitmap of the elements in its empty ring, so that _find_place () tests all the
+     * candidate bases in a block for a set of labels at once (#define USE_RING_FIND_PLACE to walk the ring instead).
     */
     struct block { // a block w/ 256 elements
       blockindex prev;   // prev block; 3 bytes
@@ -109,36 +174,108 @@ namespace cedar {
       short      reject; // minimum # branching failed to locate; soft limit
       int        trial;  // # trial
       size_type  ehead;  // first empty item  // XXX In the current block?
+#ifndef USE_RING_FIND_PLACE
+      uint64_t   empty[4]; // bitmap of elements in the empty ring
+      block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0)
+      { empty[0] = empty[1] = empty[2] = empty[3] = ~static_cast <uint64_t> (0); }
+#else
       block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0) {}
+#endif
+    };
+    struct rank_block { // leaves in a block w/ 256 elements; see freeze ()
+      size_type  count;    // # leaves in the preceding blocks
+      uint64_t   leaf[4];  // bitmap of leaves
+      rank_block () : count (0), leaf () {}
+    };
+    struct handle_rec { // a cursor; linked with the others on the same node
+      size_t node;
+      long   prev;  // -1 if first; -2 if unused
+      long   next;  // -1 if last; next unused one if unused
+    };
+    struct handle_slot { // a node with handles
+      size_t node;
+      long   head;  // first handle; -1 if empty
+      handle_slot () : node (0), head (-1) {}
     };
     //
-    da () : tracking_node (), _array (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _no_delete (false), _reject () {
+    da () : _array (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _rank (0), _capacity (0), _size (0), _num_keys (0), _nonzero_size (0), _no_delete (false), _payload (0), _payload_size (0), _payload_quota (0), _payload_no_delete (false), _reject (), _remapped (false), _handle (0), _handle_size (0), _handle_quota (0), _handle_free (-1), _num_handles (0), _hslot (0), _hslot_size (0), _hslot_used (0) {
       static_assert (sizeof (value_type) <= sizeof (baseindex), "value type is not supported maintain a value array by yourself and store its index");
       _initialize ();
+      _set_label_map (0);
     }
     //
-    ~da () { clear (false); }
+    ~da () { clear (false); std::free (_handle); std::free (_hslot); }
+    /*
+     * Move, swap and clone. A moved-from trie is left empty as if default-constructed. Copying is explicit:
+     * clone () duplicates the arrays by bulk memcpy into a compact trie (capacity == size) that owns its memory
+     * even if this one was given by set_array (), keeping handles and the frozen state.
+    */
+    da (da&& t) noexcept : da () { swap (t); } // the default constructor exits, not throws, on failure
+    da& operator= (da&& t) noexcept { da (std::move (t)).swap (*this); return *this; } // frees the old contents
+    void swap (da& t) noexcept {
+      std::swap (_array, t._array);       std::swap (_ninfo, t._ninfo);     std::swap (_block, t._block);
+      std::swap (_bheadF, t._bheadF);     std::swap (_bheadC, t._bheadC);   std::swap (_bheadO, t._bheadO);
+      std::swap (_rank, t._rank);         std::swap (_capacity, t._capacity); std::swap (_size, t._size);
+      std::swap (_num_keys, t._num_keys); std::swap (_nonzero_size, t._nonzero_size);
+      std::swap (_no_delete, t._no_delete);
+      std::swap (_payload, t._payload);   std::swap (_payload_size, t._payload_size);
+      std::swap (_payload_quota, t._payload_quota); std::swap (_payload_no_delete, t._payload_no_delete);
+      std::swap (_reject, t._reject);     std::swap (_code, t._code);       std::swap (_decode, t._decode);
+      std::swap (_remapped, t._remapped); std::swap (_max_alloc, t._max_alloc);
+      std::swap (_handle, t._handle);     std::swap (_handle_size, t._handle_size);
+      std::swap (_handle_quota, t._handle_quota); std::swap (_handle_free, t._handle_free);
+      std::swap (_num_handles, t._num_handles);
+      std::swap (_hslot, t._hslot);       std::swap (_hslot_size, t._hslot_size); std::swap (_hslot_used, t._hslot_used);
+    }
+    da clone () const {
+      da t;
+      t.clear (false);
+      const size_t size = static_cast <size_t> (_size);
+      t._array = _dup (_array, size);
+      t._ninfo = _dup (_ninfo, size);
+      t._block = _dup (_block, size >> 8);
+      t._rank  = _dup (_rank,  size >> 8);
+      t._bheadF = _bheadF; t._bheadC = _bheadC; t._bheadO = _bheadO;
+      t._capacity = t._size = _size;
+      t._num_keys = _num_keys;
+      t._nonzero_size = _nonzero_size;
+      t._payload = _dup (_payload, _payload_size);
+      t._payload_size = t._payload_quota = t._payload ? _payload_size : 0;
+      std::memcpy (t._reject, _reject, sizeof (_reject));
+      std::memcpy (t._code,   _code,   sizeof (_code));
+      std::memcpy (t._decode, _decode, sizeof (_decode));
+      t._remapped  = _remapped;
+      t._max_alloc = _max_alloc;
+      t._handle = _dup (_handle, _handle_size);
+      t._handle_size = t._handle_quota = t._handle ? _handle_size : 0;
+      t._handle_free = _handle_free;
+      t._num_handles = _num_handles;
+      t._hslot = _dup (_hslot, _hslot_size);
+      t._hslot_size = t._hslot ? _hslot_size : 0;
+      t._hslot_used = _hslot_used;
+      return t;
+    }
     //
     size_t capacity   () const { return static_cast <size_t> (_capacity); }
     size_t size       () const { return static_cast <size_t> (_size); }
     size_t total_size () const { return sizeof (node) * static_cast <size_t> (_size); }
     size_t unit_size  () const { return sizeof (node); }
     //
-    size_t nonzero_size () const {
+    // O(1) counters maintained by update () and erase ()
+    size_t nonzero_size () const { return static_cast <size_t> (_nonzero_size); }
+    size_t num_keys     () const { return static_cast <size_t> (_num_keys); }
+    // same as the above but computed by scanning the whole array; for cross-checking
+    size_t nonzero_size_by_scan () const {
       size_t i = 0;
       for (size_t to = 0; to < static_cast <size_t> (_size); ++to)
         if (_array[to].check >= 0) ++i;
       return i;
     }
     //
-    size_t num_keys () const {
+    size_t num_keys_by_scan () const {
       size_t i = 0;
-      for (baseindex to = 0; to < static_cast <baseindex> (_size); ++to)  // because equality check in #else
-#ifdef USE_REDUCED_TRIE
-        if (_array[to].check >= 0 && _array[to].value >= 0) ++i;
-#else
-        if (_array[to].check >= 0 && _array[_array[to].check].base () == to) ++i;
-#endif
+      for (size_t to = 0; to < static_cast <size_t> (_size); ++to)
+        if (_is_leaf (to)) ++i;
       return i;
     }
     // ----------------------------------------------- BEGIN interfance ------------------------------------------------
@@ -156,6 +293,62 @@ namespace cedar {
       _set_result (&result, b.x, len, from);
       return result;
     }
+    /*
+     * Lookup for sorted query streams. The searcher keeps the node ids along the path of the previous query and
+     * resumes at the node of the longest common prefix instead of starting from the root.
+     * Call reset() if the trie has been updated or erased since the last query.
+    */
+    class sorted_searcher {
+    public:
+      explicit sorted_searcher (const da& t) : _t (&t), _key (0), _path (0), _len (0), _capacity (0) {}
+      ~sorted_searcher () { std::free (_key); std::free (_path); }
+      void reset () { _len = 0; }
+      template <typename T>
+      T exactMatchSearch (const char* key) { return exactMatchSearch <T> (key, std::strlen (key)); }
+      template <typename T>
+      T exactMatchSearch (const char* key, size_t len) {
+        const da& t = *_t;
+        if (_capacity <= len) {
+          _capacity = len + 1;
+          _realloc_array (_key,  _capacity);
+          _realloc_array (_path, _capacity);
+        }
+        size_t pos = 0;
+        while (pos < _len && pos < len && _key[pos] == key[pos]) ++pos;
+        _path[0] = 0;
+        size_t from = _path[pos];
+        for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; _path[++pos] = from) {
+          if (REDUCED && t._array[from].value >= 0) break;
+          const size_t to = static_cast <size_t> (t._array[from].base ()) ^ t._code[key_[pos]];
+          if (t._array[to].check != static_cast <checkindex> (from)) break;
+          _key[pos] = key[pos];
+          from = to;
+        }
+        _len = pos; // _path[0.._len] are valid
+        nodeelement b;
+        b.i = t._find (key, from, pos, len);
+        if (b.i == CEDAR_NO_PATH) b.i = CEDAR_NO_VALUE;
+        T result;
+        t._set_result (&result, b.x, len, from);
+        return result;
+      }
+    private:
+      // currently disabled; implement these if you need
+      sorted_searcher (const sorted_searcher&);
+      sorted_searcher& operator= (const sorted_searcher&);
+      const da* _t;
+      char*     _key;      // previous query
+      size_t*   _path;     // _path[i]: node after reading i bytes of the previous query
+      size_t    _len;
+      size_t    _capacity;
+    };
+    // Looks up num keys with sorted_searcher and stores the result for key[i] in result[i]; faster for sorted keys
+    template <typename T>
+    void exactMatchSearchBatch (size_t num, const char** key, T* result, const size_t* len = 0) const {
+      sorted_searcher s (*this);
+      for (size_t i = 0; i < num; ++i)
+        result[i] = s.template exactMatchSearch <T> (key[i], len ? len[i] : std::strlen (key[i]));
+    }
     // Returns the total number of matching items and maximum result_len number of items in result_len
     template <typename T>
     size_t commonPrefixSearch (const char* key, T* result, size_t result_len) const
@@ -174,6 +367,29 @@ namespace cedar {
       }
       return num;
     }
+    /*
+     * Visitor version of commonPrefixSearch (); nothing is buffered.
+     * visitor (value, length, id) is called for each prefix of key that has a value, from the shortest one,
+     * and the enumeration stops when it returns false. The function returns the number of visited items.
+     * visitor is a template parameter so that a function object or a lambda can be inlined.
+    */
+    template <typename V>
+    size_t commonPrefixVisit (const char* key, V visitor) const
+    { return commonPrefixVisit (key, std::strlen (key), visitor); }
+    //
+    template <typename V>
+    size_t commonPrefixVisit (const char* key, size_t len, V visitor, size_t from = 0) const {
+      size_t num = 0;
+      for (size_t pos = 0; pos < len; ) {
+        nodeelement b;
+        b.i = _find (key, from, pos, pos + 1);
+        if (b.i == CEDAR_NO_VALUE) continue;
+        if (b.i == CEDAR_NO_PATH)  break;
+        ++num;
+        if (! visitor (b.x, pos, from)) break;
+      }
+      return num;
+    }
     // predict key from double array
     /*
      * Predict suffixes following given key of length = len from a node at from, and stores at most result_len elements in result.
@@ -182,11 +398,11 @@ namespace cedar {
      * The function returns the total number of suffixes (including those not stored in result).
     */
     template <typename T>
-    size_t commonPrefixPredict (const char* key, T* result, size_t result_len)
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len) const
     { return commonPrefixPredict (key, result, result_len, std::strlen (key)); }
     //
     template <typename T>
-    size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len, size_t from = 0) {
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len, size_t from = 0) const {
       size_t num (0), pos (0), p (0);
       if (_find (key, from, pos, len) == CEDAR_NO_PATH) return 0; // Here pos is incremented
       nodeelement b;
@@ -197,6 +413,106 @@ namespace cedar {
       }
       return num;
     }
+    // Visitor version of commonPrefixPredict (); see commonPrefixVisit () for visitor
+    template <typename V>
+    size_t commonPrefixPredictVisit (const char* key, V visitor) const
+    { return commonPrefixPredictVisit (key, std::strlen (key), visitor); }
+    //
+    template <typename V>
+    size_t commonPrefixPredictVisit (const char* key, size_t len, V visitor, size_t from = 0) const {
+      size_t num (0), pos (0), p (0);
+      if (_find (key, from, pos, len) == CEDAR_NO_PATH) return 0;
+      nodeelement b;
+      const size_t root = from;
+      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p, root)) {
+        ++num;
+        if (! visitor (b.x, p, from)) break;
+      }
+      return num;
+    }
+    /*
+     * Input iterators over the results of commonPrefixSearch () and commonPrefixPredict ();
+     * they dereference to result_triple_type (supply length and id to suffix() to recover keys).
+     * A default-constructed iterator is the end of any enumeration.
+    */
+    class prefix_iterator {
+    public:
+      typedef std::input_iterator_tag   iterator_category;
+      typedef result_triple_type        value_type;
+      typedef std::ptrdiff_t            difference_type;
+      typedef const result_triple_type* pointer;
+      typedef const result_triple_type& reference;
+      prefix_iterator () : _t (0), _key (0), _len (0), _pos (0), _r () {}
+      prefix_iterator (const da* t, const char* key, size_t len, size_t from = 0)
+        : _t (t), _key (key), _len (len), _pos (0), _r () { _r.id = from; ++*this; }
+      reference operator*  () const { return _r; }
+      pointer   operator-> () const { return &_r; }
+      prefix_iterator& operator++ () {
+        while (_pos < _len) {
+          nodeelement b;
+          b.i = _t->_find (_key, _r.id, _pos, _pos + 1);
+          if (b.i == CEDAR_NO_VALUE) continue;
+          if (b.i == CEDAR_NO_PATH)  break;
+          _t->_set_result (&_r, b.x, _pos, _r.id);
+          return *this;
+        }
+        _t = 0, _pos = 0; // end
+        return *this;
+      }
+      prefix_iterator operator++ (int) { prefix_iterator it (*this); ++*this; return it; }
+      bool operator== (const prefix_iterator& it) const { return _t == it._t && _pos == it._pos; }
+      bool operator!= (const prefix_iterator& it) const { return ! (*this == it); }
+    private:
+      const da*          _t;
+      const char*        _key;
+      size_t             _len;
+      size_t             _pos;
+      result_triple_type _r;
+    };
+    //
+    class predict_iterator {
+    public:
+      typedef std::input_iterator_tag   iterator_category;
+      typedef result_triple_type        value_type;
+      typedef std::ptrdiff_t            difference_type;
+      typedef const result_triple_type* pointer;
+      typedef const result_triple_type& reference;
+      predict_iterator () : _t (0), _root (0), _r () {}
+      predict_iterator (const da* t, const char* key, size_t len, size_t from = 0) : _t (t), _root (0), _r () {
+        size_t pos = 0;
+        if (_t->_find (key, from, pos, len) == CEDAR_NO_PATH) { _t = 0; return; }
+        _root = _r.id = from;
+        nodeelement b;
+        b.i = _t->begin (_r.id, _r.length);
+        _set (b);
+      }
+      reference operator*  () const { return _r; }
+      pointer   operator-> () const { return &_r; }
+      predict_iterator& operator++ () {
+        nodeelement b;
+        b.i = _t->next (_r.id, _r.length, _root);
+        _set (b);
+        return *this;
+      }
+      predict_iterator operator++ (int) { predict_iterator it (*this); ++*this; return it; }
+      bool operator== (const predict_iterator& it) const { return _t == it._t && _r.id == it._r.id; }
+      bool operator!= (const predict_iterator& it) const { return ! (*this == it); }
+    private:
+      const da*          _t;
+      size_t             _root;
+      result_triple_type _r;
+      void _set (const nodeelement& b) {
+        if (b.i == CEDAR_NO_PATH) _t = 0, _r.id = 0; // end
+        else _r.value = b.x;
+      }
+    };
+    //
+    prefix_iterator  prefix_begin  (const char* key, size_t len, size_t from = 0) const
+    { return prefix_iterator (this, key, len, from); }
+    prefix_iterator  prefix_end    () const { return prefix_iterator (); }
+    predict_iterator predict_begin (const char* key, size_t len, size_t from = 0) const
+    { return predict_iterator (this, key, len, from); }
+    predict_iterator predict_end   () const { return predict_iterator (); }
     /*
      * Recover a (sub)string key of length = len in a trie that reaches node to.
      * key must be allocated with enough memory by a user (to store a terminal character, len + 1 bytes are needed).
@@ -206,7 +522,7 @@ namespace cedar {
       key[len] = '\0';
       while (len--) {
         const checkindex from = _array[to].check;
-        key[len] = static_cast <char> (_array[from].base () ^ static_cast <baseindex> (to));
+        key[len] = static_cast <char> (_decode[_array[from].base () ^ static_cast <baseindex> (to)]);
         to = static_cast <size_t> (from);
       }
     }
@@ -226,6 +542,7 @@ namespace cedar {
      * Insert key with length = len and value = val. If len is not given, std::strlen() is used to get the length of key.
      * If key has been already present int the trie, val is added to the current value by using operator+=.
      * When you want to override the value, omit val and write a value onto the reference to the value returned by the function.
+     * The versions with inserted also tell whether key has been newly inserted, without traversing key twice.
     */
     value_type& update (const char* key)
     { return update (key, std::strlen (key)); }
@@ -236,31 +553,156 @@ namespace cedar {
     value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val = value_type (0))
     { empty_callback cf; return update (key, from, pos, len, val, cf); }
     //
+    value_type& update (const char* key, size_t len, value_type val, bool& inserted)
+    { size_t from (0), pos (0); empty_callback cf; return update (key, from, pos, len, val, cf, inserted); }
+    //
     template <typename T>
-    value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val, T& cf) {
+    value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val, T& cf)
+    { bool inserted = false; return update (key, from, pos, len, val, cf, inserted); }
+    //
+    template <typename T>
+    value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val, T& cf, bool& inserted) {
+      if (_rank) thaw ();
       if (! len && ! from) // XXX Simplify Not A And Not B with Not (A Or B)?
         _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
-#ifndef USE_FAST_LOAD
-      if (! _ninfo || ! _block) restore (); // XXX Simplify Not A Or Not B with Not (A And B)?
-#endif
-      for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; ++pos) {
-#ifdef USE_REDUCED_TRIE
-        const value_type val_ = _array[from].value;
-        if (val_ >= 0 && val_ != CEDAR_VALUE_LIMIT) // always new; correct this!
-        {
-          const size_t to = static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
-          _array[to].value = val_;
+      if (! _has_ninfo () || ! _block) restore (); // XXX Simplify Not A Or Not B with Not (A And B)?
+      for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; ++pos)
+        from = _follow_key (from, key_[pos], cf);
+      const size_t to = _follow_terminal (from, cf, inserted);
+      return _array[to].value += val;
+    }
+    /*
+     * Bulk upsert for sorted key streams. The updater keeps the node ids along the path of the previous key and
+     * resumes at the node of the longest common prefix instead of re-walking it from the root; the ids are kept
+     * valid over node moves in _resolve() by hooking the callback. Unsorted keys are accepted but gain little.
+     * Update or erase the trie by other means only after calling reset().
+    */
+    class sorted_updater {
+    public:
+      explicit sorted_updater (da& t) : _t (&t), _key (0), _path (0), _len (0), _capacity (0) {}
+      ~sorted_updater () { std::free (_key); std::free (_path); }
+      void reset () { _len = 0; }
+      value_type& update (const char* key, size_t len, value_type val = value_type (0))
+      { empty_callback cf; return update (key, len, val, cf); }
+      template <typename T>
+      value_type& update (const char* key, size_t len, value_type val, T& cf)
+      { bool inserted = false; return update (key, len, val, cf, inserted); }
+      template <typename T>
+      value_type& update (const char* key, size_t len, value_type val, T& cf, bool& inserted) {
+        if (! len) _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
+        da& t = *_t;
+        if (t._rank) t.thaw ();
+        if (! t._has_ninfo () || ! t._block) t.restore ();
+        if (_capacity <= len) {
+          _capacity = len + 1;
+          _realloc_array (_key,  _capacity);
+          _realloc_array (_path, _capacity);
         }
-#endif
-        from = static_cast <size_t> (_follow (from, key_[pos], cf));
+        size_t pos = 0;
+        while (pos < _len && pos < len && _key[pos] == key[pos]) ++pos;
+        _path[0] = 0;
+        path_callback <T> cf_ (*this, cf);
+        size_t from = _path[pos];
+        for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; _path[++pos] = from) {
+          _len = pos; // _path[0.._len] are valid
+          _key[pos] = key[pos];
+          from = t._follow_key (from, key_[pos], cf_);
+        }
+        _len = len;
+        const size_t to = t._follow_terminal (from, cf_, inserted);
+        return t._array[to].value += val;
       }
-#ifdef USE_REDUCED_TRIE
-      const size_t to = _array[from].value >= 0 ? from : static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
-      if (_array[to].value == CEDAR_VALUE_LIMIT) _array[to].value = 0;
-#else
-      const size_t to = static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
-#endif
-      return _array[to].value += val;
+    private:
+      template <typename T>
+      struct path_callback { // remap the nodes on the path if moved, then call the user callback
+        sorted_updater& u;
+        T&              cf;
+        size_t          depth; // of the parent of the last moved node on the path
+        path_callback (sorted_updater& u_, T& cf_) : u (u_), cf (cf_), depth (0) {}
+        void operator () (const baseindex from, const baseindex to) {
+          // nodes moved by one _resolve () share the parent (already the check of to), so the path is
+          // searched once per parent and only the next node on the path can be the one moved
+          const size_t parent = static_cast <size_t> (u._t->_array[to].check);
+          if (depth >= u._len || u._path[depth] != parent) {
+            depth = 0;
+            while (depth < u._len && u._path[depth] != parent) ++depth;
+          }
+          if (depth < u._len && u._path[depth + 1] == static_cast <size_t> (from))
+            u._path[depth + 1] = static_cast <size_t> (to);
+          cf (from, to);
+        }
+      };
+      // currently disabled; implement these if you need
+      sorted_updater (const sorted_updater&);
+      sorted_updater& operator= (const sorted_updater&);
+      da*     _t;
+      char*   _key;      // previous key
+      size_t* _path;     // _path[i]: node after reading i bytes of the previous key
+      size_t  _len;
+      size_t  _capacity;
+    };
+    /*
+     * Merge (union) trie t into this trie by walking the two in parallel along the child lists. Nodes missing
+     * in this trie are created one by one from those of t without extracting keys, and a key in both gets
+     * combine (value in this, value in t); see merge_sum, merge_max and merge_overwrite. The cost is linear
+     * in the nodes of t, so merge the smaller trie into the larger one. t may be a loaded trie without ninfo
+     * or have another label map. Returns the number of keys added.
+    */
+    template <typename F>
+    size_t merge (const da& t, F combine) {
+      if (&t == this) { const da c = clone (); return merge (c, combine); }
+      if (_rank) thaw ();
+      if (! _has_ninfo () || ! _block) restore ();
+      const size_type num_keys = _num_keys;
+      size_t capacity = 16;
+      _merge_callback cf = { 0, 0 };
+      _realloc_array (cf.path, capacity);
+      const _merge_frame root = { 0, 0, -1 };
+      cf.path[cf.n++] = root;
+      while (cf.n) {
+        _merge_frame& f = cf.path[cf.n - 1];
+        const baseindex base_ = t._array[f.from_].base ();
+        uchar c = 0;
+        if (f.label < 0) {
+          if (! (c = t._child (f.from_, base_)) && ! f.from_) { --cf.n; continue; } // empty trie
+        } else if (! (c = t._sibling (static_cast <size_t> (base_ ^ f.label), f.from_))) { --cf.n; continue; }
+        f.label = c;
+        const size_t to_ = static_cast <size_t> (base_ ^ c);
+        if (! c) { _merge_value (f.from, t._array[to_].value, combine, cf); continue; } // terminal
+        size_t to = _follow_label (f.from, _code[t._decode[c]], cf);
+        if (REDUCED && t._array[to_].value >= 0) { _merge_value (to, t._array[to_].value, combine, cf); continue; } // leaf
+        if (cf.n == capacity) _realloc_array (cf.path, capacity << 1, static_cast <size_type> (capacity)), capacity <<= 1;
+        const _merge_frame next = { to, to_, -1 };
+        cf.path[cf.n++] = next;
+      }
+      std::free (cf.path);
+      return static_cast <size_t> (_num_keys - num_keys);
+    }
+    struct merge_sum       { value_type operator () (const value_type a, const value_type b) const { return a + b; } };
+    struct merge_max       { value_type operator () (const value_type a, const value_type b) const { return a < b ? b : a; } };
+    struct merge_overwrite { value_type operator () (const value_type,   const value_type b) const { return b; } };
+    /*
+     * Synchronized traversal of this trie (old) and t (new). visitor (key, len, old_value, new_value) is called for each
+     * key added (old_value == CEDAR_NO_VALUE), removed (new_value == CEDAR_NO_VALUE) or changed, and the traversal stops
+     * when it returns false; key is valid during the call. A subtree in only one trie is enumerated without probing the
+     * other, and nothing is walked for the same trie. Events of a node come with the children of t first, so keys are
+     * not sorted. Returns the number of events.
+    */
+    template <typename V>
+    size_t diffVisit (const da& t, V visitor) const { return &t == this ? 0 : _diff (t, visitor, false); }
+    // keys in both tries, with the values of this trie
+    da intersect (const da& t) const {
+      da r;
+      _set_op_visitor v = { &r, true };
+      _diff (t, v, true);
+      return r;
+    }
+    // keys of this trie not in t
+    da subtract (const da& t) const {
+      da r;
+      _set_op_visitor v = { &r, false };
+      if (&t != this) _diff (t, v, false);
+      return r;
     }
     // easy-going erase () without compression
     /*
@@ -281,28 +723,119 @@ namespace cedar {
     //
     void erase (size_t from) {
       // _test ();
-#ifdef USE_REDUCED_TRIE
-      baseindex e = _array[from].value >= 0 ? static_cast <baseindex> (from) : _array[from].base () ^ 0;
-      from = static_cast <size_t> (_array[e].check);
-#else
-      baseindex e = _array[from].base () ^ 0;
-#endif
+      if (_rank) thaw ();
+      --_num_keys;
+      baseindex e = REDUCED && _array[from].value >= 0 ? static_cast <baseindex> (from) : _array[from].base () ^ 0;
+      if (REDUCED) from = static_cast <size_t> (_array[e].check);
       bool flag = false; // have sibling
       do {
         const node& n = _array[from];
-        flag = _ninfo[n.base () ^ _ninfo[from].child].sibling;
+        flag = _info (n.base () ^ _info (from).child).sibling;
         if (flag) _pop_sibling (from, n.base (), static_cast <uchar> (n.base () ^ e));
         _push_enode (e);
          e = static_cast <baseindex> (from);
         from = static_cast <size_t> (_array[from].check);
       } while (! flag);
     }
+    /*
+     * Integer sequence keys (e.g., word-id n-grams). Each id is encoded big-endian in 1 to 6 bytes; the first byte
+     * tells the length (1..0x80: 1 byte, 0x81..0xc0: 2 bytes, 0xc1..0xe0: 3 bytes, ...) and has the upper bits,
+     * and the rest have 7 bits each, tagged with 0x80. An id < 2^7 takes 1 byte, < 2^13 2 bytes, < 2^19 3 bytes,
+     * < 2^25 4 bytes. The code is prefix-free, never includes '\0' and keeps the numerical order of ids (in ordered
+     * tries), so a prefix of a sequence is a prefix of its key. The following overloads walk the trie one id at a
+     * time without building the key; lengths (n, result_pair_type::length) are in ids.
+    */
+    enum { MAX_ID_BYTES = 6 };
+    static size_t encode_id (const uint32_t id, char* key) {
+      size_t n = 1;
+      while (n < MAX_ID_BYTES && id >> (6 * n + 1)) ++n;
+      key[0] = static_cast <char> (_id_head (n) + (static_cast <uint64_t> (id) >> (7 * (n - 1))));
+      for (size_t i = 1; i < n; ++i)
+        key[i] = static_cast <char> (0x80 | ((id >> (7 * (n - 1 - i))) & 0x7f));
+      return n;
+    }
+    // key must have n * MAX_ID_BYTES bytes; returns the key length
+    static size_t encode_ids (const uint32_t* ids, const size_t n, char* key) {
+      size_t len = 0;
+      for (size_t i = 0; i < n; ++i) len += encode_id (ids[i], key + len);
+      return len;
+    }
+    // decodes key (e.g., obtained by suffix ()) into ids and returns the number of ids
+    static size_t decode_ids (const char* key, const size_t len, uint32_t* ids) {
+      size_t n = 0;
+      for (size_t pos = 0; pos < len; ++n) {
+        const uchar c = static_cast <uchar> (key[pos++]);
+        size_t m = 1;
+        while (m < MAX_ID_BYTES && c >= _id_head (m + 1)) ++m;
+        uint32_t v = c - _id_head (m);
+        for (; --m && pos < len; ++pos) v = (v << 7) | (static_cast <uchar> (key[pos]) & 0x7f);
+        ids[n] = v;
+      }
+      return n;
+    }
+    value_type& update (const uint32_t* ids, size_t n, value_type val = value_type (0))
+    { bool inserted = false; return update (ids, n, val, inserted); }
+    //
+    value_type& update (const uint32_t* ids, size_t n, value_type val, bool& inserted) {
+      if (_rank) thaw ();
+      if (! n) _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
+      if (! _has_ninfo () || ! _block) restore ();
+      empty_callback cf;
+      size_t from = 0;
+      for (size_t i = 0; i < n; ++i) {
+        char key[MAX_ID_BYTES];
+        for (size_t pos = 0, len = encode_id (ids[i], key); pos < len; ++pos)
+          from = _follow_key (from, static_cast <uchar> (key[pos]), cf);
+      }
+      const size_t to = _follow_terminal (from, cf, inserted);
+      return _array[to].value += val;
+    }
+    //
+    template <typename T>
+    T exactMatchSearch (const uint32_t* ids, size_t n) const {
+      nodeelement b;
+      size_t from = 0;
+      b.i = _find_ids (ids, n, from);
+      if (b.i == CEDAR_NO_PATH) b.i = CEDAR_NO_VALUE;
+      T result;
+      _set_result (&result, b.x, n, from);
+      return result;
+    }
+    // results for the prefixes of ids that are in the trie, from the shortest one
+    template <typename T>
+    size_t commonPrefixSearch (const uint32_t* ids, T* result, size_t result_len, size_t n) const {
+      size_t num = 0, from = 0;
+      for (size_t i = 0; i < n; ++i) {
+        nodeelement b;
+        b.i = _find_ids (ids + i, 1, from);
+        if (b.i == CEDAR_NO_VALUE) continue;
+        if (b.i == CEDAR_NO_PATH)  return num;
+        if (num < result_len) _set_result (&result[num], b.x, i + 1, from);
+        ++num;
+      }
+      return num;
+    }
+    //
+    int erase (const uint32_t* ids, size_t n) {
+      size_t from = 0;
+      const baseindex i = _find_ids (ids, n, from);
+      if (i == CEDAR_NO_PATH || i == CEDAR_NO_VALUE) return -1;
+      erase (from);
+      return 0;
+    }
     // Accepts unsorted keys
     int build (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0) {
       for (size_t i = 0; i < num; ++i)
         update (key[i], len ? len[i] : std::strlen (key[i]), val ? val[i] : value_type (i));
       return 0;
     }
+    // Same as build() but faster for sorted keys; see sorted_updater
+    int build_sorted (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0) {
+      sorted_updater u (*this);
+      for (size_t i = 0; i < num; ++i)
+        u.update (key[i], len ? len[i] : std::strlen (key[i]), val ? val[i] : value_type (i));
+      return 0;
+    }
     /* Recover all the keys from the trie. Use suffix() to obtain actual key strings
      * (this function works as commonPrefixPredict() from the root).
      * To get all the results, result must be allocated with enough memory (result_len = num_keys()) by a user.
@@ -320,6 +853,268 @@ namespace cedar {
         else
           _err (__FILE__, __LINE__, "dump() needs array of length = num_keys()\n");
     }
+    // Visitor version of dump (); see commonPrefixVisit () for visitor
+    template <typename V>
+    size_t dumpVisit (V visitor) const {
+      nodeelement b;
+      size_t num (0), from (0), p (0);
+      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p)) {
+        ++num;
+        if (! visitor (b.x, p, from)) break;
+      }
+      return num;
+    }
+    /*
+     * Minimal perfect hash: freeze() builds a rank directory over leaf nodes (a leaf bitmap and a cumulative count
+     * per block; 1.25 bits per node), after which key_id() maps a key to a dense id in [0, num_keys()) and
+     * id_to_key() (or id_to_node() and suffix()) gives the key back, so ids need not be stored as values.
+     * Ids follow the node order, not the key order. update() and erase() discard the directory (call freeze() again).
+    */
+    void freeze () {
+      thaw ();
+      const size_t num_blocks = static_cast <size_t> (_size) >> 8;
+      _realloc_array (_rank, num_blocks);
+      size_type count = 0;
+      for (size_t bi = 0; bi < num_blocks; ++bi) {
+        rank_block& r = _rank[bi];
+        r.count = count;
+        for (size_t i = 0; i < 256; ++i)
+          if (_is_leaf ((bi << 8) | i)) r.leaf[i >> 6] |= static_cast <uint64_t> (1) << (i & 63), ++count;
+      }
+    }
+    //
+    void thaw () { std::free (_rank); _rank = 0; }
+    //
+    bool frozen () const { return _rank; }
+    // Returns CEDAR_NO_VALUE if key is not in the trie
+    baseindex key_id (const char* key) const { return key_id (key, std::strlen (key)); }
+    //
+    baseindex key_id (const char* key, size_t len) const {
+      if (! _rank) _err (__FILE__, __LINE__, "key_id() needs freeze()\n");
+      size_t from (0), pos (0);
+      const baseindex i = _find (key, from, pos, len);
+      if (i == CEDAR_NO_PATH || i == CEDAR_NO_VALUE) return CEDAR_NO_VALUE;
+      if (REDUCED && _array[from].value >= 0) return _rank_leaf (from); // leaf
+      return _rank_leaf (static_cast <size_t> (_array[from].base () ^ 0));
+    }
+    // Returns the node id and length (len) of the key with id, which suffix() takes
+    size_t id_to_node (const size_t id, size_t& len) const {
+      if (! _rank) _err (__FILE__, __LINE__, "id_to_node() needs freeze()\n");
+      if (id >= static_cast <size_t> (_num_keys)) _err (__FILE__, __LINE__, "id out of range\n");
+      size_t to = _select_leaf (id);
+      const checkindex from = _array[to].check;
+      if (! (_array[from].base () ^ static_cast <baseindex> (to))) to = static_cast <size_t> (from); // terminal
+      len = 0;
+      for (size_t n = to; n; n = static_cast <size_t> (_array[n].check)) ++len;
+      return to;
+    }
+    // Writes the key with id into key if it fits key_len bytes (including '\0'); returns the key length
+    size_t id_to_key (const size_t id, char* key, const size_t key_len) const {
+      size_t len = 0;
+      const size_t to = id_to_node (id, len);
+      if (len < key_len) suffix (key, len, to);
+      return len;
+    }
+    /*
+     * Payload store: variable-length byte strings in an append-only arena of length-prefixed (varint) records,
+     * referenced from the values of their keys. In a trie with payloads, every value is the offset of a record,
+     * so do not update() such keys by yourself. Records of overwritten or erased keys stay in the arena until
+     * compact_payload(). save() writes the arena to fn + ".pld" and open() reads it if any; a memory-mapped
+     * arena can be given by set_payload_array() (after set_array()).
+    */
+    void set_payload (const char* key, size_t len, const void* data, size_t size) {
+      const size_t offset = _append_payload (data, size);
+      if (static_cast <size_t> (static_cast <value_type> (offset)) != offset)
+        _err (__FILE__, __LINE__, "payload store is too large for value_type\n");
+      update (key, len) = static_cast <value_type> (offset);
+    }
+    //
+    payload_type get_payload (const char* key) const { return get_payload (key, std::strlen (key)); }
+    //
+    payload_type get_payload (const char* key, size_t len) const {
+      const value_type offset = exactMatchSearch <value_type> (key, len);
+      if (offset < 0 || static_cast <size_t> (offset) >= _payload_size) { payload_type p = { 0, 0 }; return p; }
+      return _read_payload (static_cast <size_t> (offset));
+    }
+    // Moves the records referenced by keys to a new arena; returns # bytes reclaimed
+    size_t compact_payload () {
+      if (! _payload_size) return 0;
+      char* payload = 0;
+      _realloc_array (payload, _payload_size);
+      size_t size = 0;
+      for (size_t to = 0; to < static_cast <size_t> (_size); ++to) {
+        if (! _is_leaf (to)) continue;
+        value_type& offset = _array[to].value;
+        if (offset < 0 || static_cast <size_t> (offset) >= _payload_size) continue;
+        const payload_type p = _read_payload (static_cast <size_t> (offset));
+        const size_t n = static_cast <size_t> (p.data - &_payload[offset]) + p.size;
+        std::memcpy (&payload[size], &_payload[offset], n);
+        offset = static_cast <value_type> (size);
+        size += n;
+      }
+      if (! _payload_no_delete) std::free (_payload);
+      const size_t reclaimed = _payload_size - size;
+      _payload = payload;
+      _payload_size = _payload_quota = size;
+      _payload_no_delete = false;
+      return reclaimed;
+    }
+    //
+    size_t payload_size () const { return _payload_size; }
+    //
+    const void* payload_array () const { return _payload; }
+    //
+    void set_payload_array (const void* p, size_t size) { // ad-hoc
+      _clear_payload ();
+      _payload = static_cast <char*> (const_cast <void*> (p)); // copied before written
+      _payload_size = _payload_quota = size;
+      _payload_no_delete = true;
+    }
+    //
+    /*
+     * Label remapping: key bytes are translated through a 256-entry table into the labels of the trie, so that
+     * giving small codes to frequent bytes packs sibling nodes more densely into blocks and reduces node moves
+     * in _resolve(). The table is set on an empty trie, either directly (code[c] for c = 1..255 must be
+     * a permutation of 1..255; 0 sets identity) or from the byte frequency of sample keys, and it is saved
+     * with the trie. Note that keys are enumerated in the order of the labels, not the bytes, in a remapped trie.
+    */
+    void set_label_map (const uchar* code) {
+      if (_num_keys) _err (__FILE__, __LINE__, "label map must be set on an empty trie\n");
+      _set_label_map (code);
+    }
+    //
+    void set_label_map (size_t num, const char** key, const size_t* len = 0) {
+      size_t count[256] = {0};
+      for (size_t i = 0; i < num; ++i) {
+        const uchar* const key_ = reinterpret_cast <const uchar*> (key[i]);
+        for (size_t j = 0, n = len ? len[i] : std::strlen (key[i]); j < n; ++j) ++count[key_[j]];
+      }
+      uchar byte[255], code[256];
+      for (size_t c = 1; c < 256; ++c) { // insertion sort by count, stable
+        size_t j = c - 1;
+        for (; j > 0 && count[byte[j - 1]] < count[c]; --j) byte[j] = byte[j - 1];
+        byte[j] = static_cast <uchar> (c);
+      }
+      code[0] = 0;
+      for (size_t j = 0; j < 255; ++j) code[byte[j]] = static_cast <uchar> (j + 1);
+      set_label_map (code);
+    }
+    //
+    const uchar* label_map () const { return _code; }
+    /*
+     * Visit the elements of the array that exactMatchSearch (key) reads, from the root to the terminal
+     * (including the last one that fails to match); visitor (id) is called for each. This tells how a lookup
+     * touches memory, e.g., the number of cache lines or pages.
+    */
+    template <typename V>
+    void pathVisit (const char* key, size_t len, V visitor) const {
+      size_t from = 0;
+      visitor (from);
+      for (const uchar* key_ = reinterpret_cast <const uchar*> (key), * const end = key_ + len; key_ != end; ++key_) {
+        if (REDUCED && _array[from].value >= 0) return;
+        const size_t to = static_cast <size_t> (_array[from].base ()) ^ _code[*key_];
+        visitor (to);
+        if (_array[to].check != static_cast <checkindex> (from)) return;
+        from = to;
+      }
+      if (REDUCED && _array[from].value >= 0) return;
+      visitor (static_cast <size_t> (_array[from].base ()) ^ 0);
+    }
+    /*
+     * Relayout for cache locality: rebuild the array from scratch with the frequency of nodes read by sample queries
+     * (e.g., a query log). Hot nodes (read by any query) are placed first by a depth-first walk that follows
+     * the more frequent child first, and then the rest by a depth-first walk in label order; each sibling set
+     * goes to the first room after its parent, so a hot path occupies a few adjacent cache lines and blocks at the
+     * head of the array. Keys, values and counters are kept; node ids change (handles are updated).
+     * Slow; meant for an offline tool (see relayout.cc).
+    */
+    void relayout (size_t num, const char** key, const size_t* len = 0) {
+      if (_rank) thaw ();
+      const size_t size = static_cast <size_t> (_size);
+      size_t*    weight = static_cast <size_t*> (std::calloc (size, sizeof (size_t)));
+      size_t*    to_    = static_cast <size_t*> (std::malloc (sizeof (size_t) * size));    // new id
+      baseindex* base_  = static_cast <baseindex*> (std::malloc (sizeof (baseindex) * size)); // new base
+      size_t*    stack  = static_cast <size_t*> (std::malloc (sizeof (size_t) * size));
+      if (! weight || ! to_ || ! base_ || ! stack) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      _weight_counter counter = { weight };
+      for (size_t i = 0; i < num; ++i)
+        pathVisit (key[i], len ? len[i] : std::strlen (key[i]), counter);
+      for (size_t i = 0; i < size; ++i) base_[i] = -1;
+      _layout layout (size >> 8);
+      layout.use (to_[0] = 0); // root
+      size_t hot_end = 0;
+      for (int cold = 0; cold <= 1; ++cold) {
+        size_t n = 0;
+        stack[n++] = 0;
+        while (n) {
+          const size_t from = stack[--n];
+          if (! _has_child (from) || (! cold && ! weight[from])) continue;
+          const size_t base = static_cast <size_t> (_array[from].base ());
+          uchar label[256];
+          short k = 0;
+          for (size_t c = 0; c < 256; ++c)
+            if (_array[base ^ c].check == static_cast <checkindex> (from))
+              label[k++] = static_cast <uchar> (c);
+          if (base_[from] < 0 && k) { // place children
+            const size_t start = to_[from] + 1;
+            const size_t b = ! from ? 0 : layout.find (label, k, cold && start < hot_end ? hot_end : start); // root's base stays 0
+            for (short j = 0; j < k; ++j) layout.use (to_[base ^ label[j]] = b ^ label[j]);
+            base_[from] = static_cast <baseindex> (b);
+            if (! cold && b + 256 > hot_end) hot_end = (b | 0xff) + 1;
+          }
+          if (cold) // visit children in label order
+            for (short j = k; j > 0; --j) stack[n++] = base ^ label[j - 1];
+          else { // visit hot children, more frequent first
+            const size_t n_ = n;
+            for (short j = 0; j < k; ++j) {
+              const size_t to = base ^ label[j];
+              if (! weight[to]) continue;
+              size_t i = n++;
+              for (; i > n_ && weight[stack[i - 1]] > weight[to]; --i) stack[i] = stack[i - 1];
+              stack[i] = to;
+            }
+          }
+        }
+      }
+      // build the new array
+      const size_t size_ = layout.num_blocks << 8;
+      node* array = static_cast <node*> (std::malloc (sizeof (node) * size_));
+      if (! array) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      for (size_t bi = 0; bi < layout.num_blocks; ++bi) { // link empty elements in each block
+        size_t first = 0, prev = 0;
+        for (size_t e = bi << 8; e < (bi + 1) << 8; ++e) {
+          if (layout.used_at (e)) continue;
+          if (first) array[e].base_ = - static_cast <baseindex> (prev), array[prev].check = - static_cast <checkindex> (e);
+          else first = e;
+          prev = e;
+        }
+        if (first) array[first].base_ = - static_cast <baseindex> (prev), array[prev].check = - static_cast <checkindex> (first);
+      }
+      for (size_t from = 0; from < size; ++from) {
+        const node& n = _array[from];
+        if (from && n.check < 0) continue;
+        node& n_ = array[to_[from]];
+        n_ = node (n.base_, from ? static_cast <checkindex> (to_[n.check]) : -1);
+        if (base_[from] >= 0) n_.base_ = REDUCED ? - (base_[from] + 1) : base_[from];
+      }
+      for (size_t h = 0; h < _handle_size; ++h) {
+        size_t& from = _handle[h].node;
+        if (_handle[h].prev != -2) from = from < size && (! from || _array[from].check >= 0) ? to_[from] : 0;
+      }
+      _relink_handles ();
+      if (_array && ! _no_delete) std::free (_array);
+      _array = array;
+      _no_delete = false;
+      _size = _capacity = static_cast <size_type> (size_);
+      std::free (_ninfo); _ninfo = 0;
+      std::free (_block); _block = 0;
+      _restore_ninfo ();
+      _restore_block ();
+      std::free (weight);
+      std::free (to_);
+      std::free (base_);
+      std::free (stack);
+    }
     //
     int save (const char* fn, const char* mode = "wb") const {
       // _test ();
@@ -327,18 +1122,33 @@ namespace cedar {
       if (! fp) return -1;
       std::fwrite (_array, sizeof (node), static_cast <size_t> (_size), fp);
       std::fclose (fp);
-#ifdef USE_FAST_LOAD
-      const char* const info = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fwrite (&_bheadF, sizeof (_bheadF), 1, fp);
-      std::fwrite (&_bheadC, sizeof (_bheadC), 1, fp);
-      std::fwrite (&_bheadO, sizeof (_bheadO), 1, fp);
-      std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
-      std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
-      std::fclose (fp);
+      if (_save_header (fn, mode) != 0) return -1;
+      const char* const pld = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".pld");
+      if (_payload_size) {
+        fp = std::fopen (pld, mode);
+        delete [] pld;
+        if (! fp) return -1;
+        std::fwrite (_payload, sizeof (char), _payload_size, fp);
+        std::fclose (fp);
+      } else { // or open () would load the payload of an earlier save
+        std::remove (pld);
+        delete [] pld;
+      }
+      if (FAST_LOAD) {
+        if (! _has_ninfo () || ! _block) return -1; // restore () a stripped trie first
+        const char* const info = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
+        fp = std::fopen (info, mode);
+        delete [] info; // resolve memory leak
+        if (! fp) return -1;
+        std::fwrite (&_bheadF, sizeof (_bheadF), 1, fp);
+        std::fwrite (&_bheadC, sizeof (_bheadC), 1, fp);
+        std::fwrite (&_bheadO, sizeof (_bheadO), 1, fp);
+#ifndef USE_COLOCATED_NINFO
+        std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
 #endif
+        std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
+        std::fclose (fp);
+      }
       return 0;
     }
     //
@@ -347,73 +1157,95 @@ namespace cedar {
       if (! fp) return -1;
       // get size
       if (! size_) {
-        if (std::fseek (fp, 0, SEEK_END) != 0) return -1;
-        size_ = static_cast <size_t> (std::ftell (fp));
-        if (std::fseek (fp, 0, SEEK_SET) != 0) return -1;
+        const long end = std::fseek (fp, 0, SEEK_END) == 0 ? std::ftell (fp) : -1;
+        if (end < 0) { std::fclose (fp); return -1; }
+        size_ = static_cast <size_t> (end);
       }
-      if (size_ <= offset) return -1;
+      if (size_ <= offset || ((size_ - offset) / sizeof (node)) & 0xff || // not whole blocks
+          std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0)
+        { std::fclose (fp); return -1; }
       // set array
       clear (false);
       size_ = (size_ - offset) / sizeof (node);
-      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
       _array = static_cast <node*>  (std::malloc (sizeof (node)  * size_));
-#ifdef USE_FAST_LOAD
-      _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
-      _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
-      if (! _array || ! _ninfo || ! _block)
-#else
-        if (! _array)
+      if (FAST_LOAD) {
+#ifndef USE_COLOCATED_NINFO
+        _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
 #endif
-          _err (__FILE__, __LINE__, "memory allocation failed\n");
-      if (size_ != std::fread (_array, sizeof (node), size_, fp)) return -1;
+        _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
+      }
+      if (! _array || (FAST_LOAD && (! _has_ninfo () || ! _block)))
+        _err (__FILE__, __LINE__, "memory allocation failed\n");
+      bool read = size_ == std::fread (_array, sizeof (node), size_, fp);
       std::fclose (fp);
+      if (! read) return -1;
       _size = static_cast <size_type> (size_);
-#ifdef USE_FAST_LOAD
-      const char* const info = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fread (&_bheadF, sizeof (_bheadF), 1, fp);
-      std::fread (&_bheadC, sizeof (_bheadC), 1, fp);
-      std::fread (&_bheadO, sizeof (_bheadO), 1, fp);
-      if (size_ != std::fread (_ninfo, sizeof (ninfo), size_, fp) ||
-          size_ != std::fread (_block, sizeof (block), size_ >> 8, fp) << 8)
-        return -1;
-      std::fclose (fp);
-      _capacity = _size;
+      if (_open_header (fn, mode) != 0 || _open_payload (fn, mode) != 0) return -1;
+      if (FAST_LOAD) {
+        const char* const info = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
+        fp = std::fopen (info, mode);
+        delete [] info; // resolve memory leak
+        if (! fp) return -1;
+        std::fread (&_bheadF, sizeof (_bheadF), 1, fp);
+        std::fread (&_bheadC, sizeof (_bheadC), 1, fp);
+        std::fread (&_bheadO, sizeof (_bheadO), 1, fp);
+        read =
+#ifndef USE_COLOCATED_NINFO
+          size_ == std::fread (_ninfo, sizeof (ninfo), size_, fp) &&
 #endif
+          size_ == std::fread (_block, sizeof (block), size_ >> 8, fp) << 8;
+        std::fclose (fp);
+        if (! read) return -1;
+        _capacity = _size;
+      }
       return 0;
     }
     //
-#ifndef USE_FAST_LOAD
     /*
      * When you load an immutable double array, extra data needed to do predict(), dump() and update()
      * are on-demand recovered when the function executed. This will incur some overhead (at the first execution).
      * To avoid this, a user can explicitly run restore() just after loading the trie.
-     * This command is not defined when you configure --enable-fast-load since the configuration allows you to
-     * directly save/load a mutable double array.
+     * With FAST_LOAD (--enable-fast-load), open() loads the extra data saved by save(), so this is needed
+     * only after strip() or set_array().
     */
     void restore () { // restore information to update
       if (! _block) _restore_block ();
-      if (! _ninfo) _restore_ninfo ();
+      if (! _has_ninfo ()) _restore_ninfo ();
       _capacity = _size;
     }
+    // the opposite of restore (); a read-only trie needs only the double array
+    // (ninfo co-located with USE_COLOCATED_NINFO stays in the nodes)
+    void strip () {
+#ifndef USE_COLOCATED_NINFO
+      std::free (_ninfo); _ninfo = 0;
 #endif
+      std::free (_block); _block = 0;
+    }
     //
-    void set_array (void* p, size_t size_ = 0) { // ad-hoc
+    // fn, if given, is the file the array was saved to; its counters and label map are taken from <fn>.hdr
+    int set_array (void* p, size_t size_ = 0, const char* fn = 0) { // ad-hoc; -1 if <fn>.hdr is broken
       clear (false);
       _array = static_cast <node*> (p);
-      _size  = static_cast <size_type> (size_);
+      _size  = static_cast <size_type> (size_ & ~static_cast <size_t> (0xff));
       _no_delete = true;
+      if (fn) return _open_header (fn, "rb");
+      _set_counter (0);
+      return 0;
     }
     //
     const void* array () const { return _array; }
     //
     void clear (const bool reuse = true) {
-      if (_array && ! _no_delete) std::free (_array); _array = 0;  // XXX _no_delete = false HERE as if freed should not double free...
-      if (_ninfo) std::free (_ninfo); _ninfo = 0;
-      if (_block) std::free (_block); _block = 0;
-      _bheadF = _bheadC = _bheadO = _capacity = _size = 0; // *
+      if (! _no_delete) std::free (_array);  // XXX _no_delete = false HERE as if freed should not double free...
+      _array = 0;
+      std::free (_ninfo); _ninfo = 0;
+      std::free (_block); _block = 0;
+      thaw ();
+      _clear_payload ();
+      _set_label_map (0);
+      _bheadF = _bheadC = _bheadO = _capacity = _size = _num_keys = _nonzero_size = 0; // *
+      for (size_t h = 0; h < _handle_size; ++h) _handle[h].node = 0;
+      _relink_handles ();
       if (reuse) _initialize ();  // XXX _no_delete = false HERE if reinitialised else it should be left as is...
       _no_delete = false;  // XXX This should be at the above two position in the if statements...
     }
@@ -425,21 +1257,21 @@ namespace cedar {
      * remember to specify the depth of that node in the trie as len.
     */
     baseindex begin (size_t& from, size_t& len) {
-#ifndef USE_FAST_LOAD
-      if (! _ninfo) _restore_ninfo ();
-#endif
+      if (! _has_ninfo ()) _restore_ninfo ();
+      return static_cast <const da&> (*this).begin (from, len);
+    }
+    // const version never restores ninfo; child labels are probed from the double array if ninfo is missing
+    baseindex begin (size_t& from, size_t& len) const {
       baseindex base = _array[from].base ();
-      uchar     c    = _ninfo[from].child;
-      if (! from && ! (c = _ninfo[base ^ c].sibling)) // bug fix // XXX Simplify Not A And Not B with Not (A Or B)?
-        return CEDAR_NO_PATH; // no entry
+      uchar     c    = _child (from, base);
+      if (! from && ! c) return CEDAR_NO_PATH; // no entry
       for (; c; ++len) {
-        from = static_cast <size_t> (_array[from].base ()) ^ c;
-        c    = _ninfo[from].child;
+        from = static_cast <size_t> (base) ^ c;
+        base = _array[from].base ();
+        c    = _child (from, base);
       }
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value >= 0) return _array[from].value;
-#endif
-      return _array[_array[from].base () ^ c].base ();
+      if (REDUCED && _array[from].value >= 0) return _array[from].value;
+      return _array[base ^ c].base_; // value
     }
     // return the next child if any
     /*
@@ -450,38 +1282,74 @@ namespace cedar {
      * while len will be the depth of the node. This function is assumed to be called after calling begin() or next().
     */
     baseindex next (size_t& from, size_t& len, const size_t root = 0) {
+      if (! _has_ninfo ()) _restore_ninfo ();
+      return static_cast <const da&> (*this).next (from, len, root);
+    }
+    //
+    baseindex next (size_t& from, size_t& len, const size_t root = 0) const {
       uchar c = 0;
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value < 0)
-#endif
-        c = _ninfo[_array[from].base () ^ 0].sibling;
+      if (! REDUCED || _array[from].value < 0)
+        c = _sibling (static_cast <size_t> (_array[from].base () ^ 0), from);
       for (; ! c && from != root; --len) {  // XXX Simplify Not A And Not B with Not (A Or B)?
-        c = _ninfo[from].sibling;
+        const size_t to = from;
         from = static_cast <size_t> (_array[from].check);
+        c = _sibling (to, from);
       }
       return c ?
         begin (from = static_cast <size_t> (_array[from].base ()) ^ c, ++len) :
-        CEDAR_NO_PATH;
+        static_cast <baseindex> (CEDAR_NO_PATH);
     }
     // test the validity of double array for debug
     void test (const size_t from = 0) const {
       const baseindex base = _array[from].base ();
-      uchar c = _ninfo[from].child;
+      uchar c = _info (from).child;
       do {
         if (from) assert (_array[base ^ c].check == static_cast <checkindex> (from));
         if (c  && _array[base ^ c].value < 0) // correct this
           test (static_cast <size_t> (base ^ c));
-      } while ((c = _ninfo[base ^ c].sibling));
+      } while ((c = _info (base ^ c).sibling));
     }
-    //
-    size_t tracking_node[NUM_TRACKING_NODES + 1];
+    /*
+     * Handles are cursors (node ids as given to and returned by traverse () or update ()) that stay valid while
+     * update () relocates nodes; a node moved by _resolve () carries its handles in O(1) through a hash table
+     * from node ids to handles. Any number of handles can be kept; clear () moves all of them back to the root.
+    */
+    size_t add_handle (const size_t from = 0) { // register a cursor; returns its handle
+      long h = _handle_free;
+      if (h >= 0) _handle_free = _handle[h].next;
+      else {
+        if (_handle_size == _handle_quota) {
+          _handle_quota = _handle_quota ? _handle_quota << 1 : 16;
+          _realloc_array (_handle, _handle_quota, static_cast <size_type> (_handle_size));
+        }
+        h = static_cast <long> (_handle_size++);
+      }
+      _handle[h].node = from;
+      _link_handle (h);
+      ++_num_handles;
+      return static_cast <size_t> (h);
+    }
+    size_t handle_node (const size_t h) const { return _handle[h].node; }
+    void set_handle (const size_t h, const size_t from) { // move a cursor, e.g., after traverse ()
+      _unlink_handle (static_cast <long> (h));
+      _handle[h].node = from;
+      _link_handle (static_cast <long> (h));
+    }
+    void erase_handle (const size_t h) {
+      _unlink_handle (static_cast <long> (h));
+      _handle[h].prev = -2; // unused
+      _handle[h].next = _handle_free;
+      _handle_free = static_cast <long> (h);
+      --_num_handles;
+    }
+    size_t num_handles () const { return _num_handles; }
     //
     void set_max_alloc (const size_t max = 0) {
         _max_alloc = max;
     }
     // ------------------------------------------------ END interfance -------------------------------------------------
   private:
-    // currently disabled; implement these if you need
+    // disabled; see clone ()
     da (const da&);
     da& operator= (const da&);
     //
@@ -491,16 +1359,42 @@ namespace cedar {
     blockindex _bheadF;  // first block of Full;   0
     blockindex _bheadC;  // first block of Closed; 0 if no Closed
     blockindex _bheadO;  // first block of Open;   0 if no Open
+    rank_block* _rank;   // 0 unless frozen
     size_type  _capacity;
     size_type  _size;
+    size_type  _num_keys;
+    size_type  _nonzero_size;
     bool       _no_delete;  // Bool not int
+    char*      _payload;  // payload store
+    size_t     _payload_size;
+    size_t     _payload_quota;
+    bool       _payload_no_delete;
     short      _reject[257];
+    uchar      _code[256];    // label of a key byte
+    uchar      _decode[256];  // key byte of a label
+    bool       _remapped;     // _code is not identity
     size_t     _max_alloc = 0;
+    handle_rec*  _handle;      // handles; see add_handle ()
+    size_t       _handle_size;
+    size_t       _handle_quota;
+    long         _handle_free; // first unused handle; -1 if none
+    size_t       _num_handles;
+    handle_slot* _hslot;       // node id -> its first handle; open addressing
+    size_t       _hslot_size;  // power of 2
+    size_t       _hslot_used;
     //
     static void _err (const char* fn, const size_t ln, const char* msg){
       std::fprintf (stderr, "cedar: %s [%zu]: %s", fn, ln, msg); std::exit (1); }
     //
     template <typename T>
+    static T* _dup (const T* p, const size_t n) { // 0 if nothing to copy
+      if (! p || ! n) return 0;
+      T* q = static_cast <T*> (std::malloc (sizeof (T) * n));
+      if (! q) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      std::memcpy (static_cast <void*> (q), p, sizeof (T) * n);
+      return q;
+    }
+    template <typename T>
     static void _realloc_array (T*& p, const size_t size_n, const size_type size_p = 0) {
       void* tmp = std::realloc (p, sizeof (T) * size_n);
       if (! tmp)
@@ -512,18 +1406,17 @@ namespace cedar {
     //
     void _initialize () { // initilize the first special block
       _realloc_array (_array, 256, 256);
+#ifndef USE_COLOCATED_NINFO
       _realloc_array (_ninfo, 256);
-      _realloc_array (_block, 1);  // XXX Is this ok? Shouldn't this be initialized?
-#ifdef USE_REDUCED_TRIE
-      _array[0] = node (-1, -1);
-#else
-      _array[0] = node (0, -1);
 #endif
+      _realloc_array (_block, 1);  // XXX Is this ok? Shouldn't this be initialized?
+      _array[0] = node (REDUCED ? -1 : 0, -1);
       // node (-255, -2), node (-1, -3), node (-2, -4), ..., node (-252, -254), node (-253, -255), node (255, -1)
       for (short i = 1; i < 256; ++i) _array[i] = node (i == 1 ? -255 : - (i - 1), i == 255 ? -1 : - (i + 1));
       _block[0].ehead = 1; // bug fix for erase
+      _set_empty (0, false); // root
       _capacity = _size = 256;
-      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = 0;
+      _num_keys = _nonzero_size = 0;
       for (short i = 1; i <= 257; ++i) _reject[i-1] = i;  // This version do not cast i + 1 up to int
     }
     // follow/create edge
@@ -538,36 +1431,246 @@ namespace cedar {
         to = _resolve (from, base, label, cf);
       return to;
     }
+    // follow/create edge for a key byte
+    template <typename T>
+    size_t _follow_key (size_t& from, const uchar label, T& cf)
+    { return _follow_label (from, _code[label], cf); }
+    // the same for a label (mapped by _code); in the reduced trie, the value on a leaf is moved to its terminal first
+    template <typename T>
+    size_t _follow_label (size_t& from, const uchar label, T& cf) {
+      if (REDUCED) {
+        const value_type val_ = _array[from].value;
+        if (val_ >= 0 && val_ != CEDAR_VALUE_LIMIT) // always new; correct this!
+        {
+          const size_t to = static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
+          _array[to].value = val_;
+        }
+      }
+      return static_cast <size_t> (_follow (from, label, cf));
+    }
+    // follow/create the node storing the value of a key that ends at from
+    template <typename T>
+    size_t _follow_terminal (size_t& from, T& cf, bool& inserted) {
+      size_t to = 0;
+      if (REDUCED) {
+        to = _array[from].value >= 0 ? from : static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
+        if ((inserted = _array[to].value == CEDAR_VALUE_LIMIT)) _array[to].value = 0; // fresh node
+      } else {
+        const baseindex base = _array[from].base ();
+        inserted = base < 0 || _array[base ^ 0].check != static_cast <checkindex> (from);
+        to = static_cast <size_t> (_follow (from, 0, cf));  // Only used for array indexing
+      }
+      if (inserted) ++_num_keys;
+      return to;
+    }
+    // node in this trie and in the merged one, and the last child label visited in the latter
+    struct _merge_frame { size_t from, from_; int label; };
+    struct _merge_callback { // remap the nodes on the path of merge () if moved
+      _merge_frame* path;
+      size_t        n;
+      void operator () (const baseindex from, const baseindex to) {
+        for (size_t i = 0; i < n; ++i)
+          if (path[i].from == static_cast <size_t> (from)) { path[i].from = static_cast <size_t> (to); break; }
+      }
+    };
+    template <typename F, typename T>
+    void _merge_value (size_t& from, const value_type val, F& combine, T& cf) {
+      bool inserted = false;
+      const size_t to = _follow_terminal (from, cf, inserted); // may reallocate _array
+      _array[to].value = inserted ? val : combine (_array[to].value, val);
+    }
+    // nodes in this trie and t, the last child label visited, and whether the children of t are done
+    struct _diff_frame { size_t from, from_; int label; bool removed; };
+    template <typename V>
+    struct _diff_state { // key buffer and event counter of _diff ()
+      V&     visitor;
+      bool   all; // unchanged keys too
+      bool   stop;
+      size_t num;
+      char*  key;
+      size_t capacity;
+      _diff_state (V& visitor_, const bool all_) : visitor (visitor_), all (all_), stop (false), num (0), key (0), capacity (0) {}
+      ~_diff_state () { std::free (key); }
+      void reserve (const size_t len) {
+        if (len < capacity) return;
+        const size_t capacity_ = capacity;
+        while (capacity <= len) capacity = capacity ? capacity << 1 : 256;
+        _realloc_array (key, capacity, static_cast <size_type> (capacity_));
+      }
+      void emit (const size_t len, const value_type old_value, const value_type new_value) {
+        if (stop || (old_value == new_value && (! all || old_value == CEDAR_NO_VALUE))) return;
+        key[len] = '\0';
+        ++num;
+        if (! visitor (static_cast <const char*> (key), len, old_value, new_value)) stop = true;
+      }
+    };
+    struct _set_op_visitor { // intersect () and subtract ()
+      da*  r;
+      bool common;
+      bool operator () (const char* key, const size_t len, const value_type old_value, const value_type new_value) {
+        if (old_value != CEDAR_NO_VALUE && (new_value != CEDAR_NO_VALUE) == common) r->update (key, len) = old_value;
+        return true;
+      }
+    };
+    template <typename V>
+    size_t _diff (const da& t, V& visitor, const bool all) const {
+      _diff_state <V> s (visitor, all);
+      size_t capacity = 16, n = 0;
+      _diff_frame* path = 0;
+      _realloc_array (path, capacity);
+      const _diff_frame root = { 0, 0, -1, false };
+      path[n++] = root;
+      while (n && ! s.stop) {
+        _diff_frame& f = path[n - 1];
+        const size_t d = n - 1; // depth
+        const da& u = f.removed ? *this : t; // children of t, then those of this trie missing in t
+        const size_t from = f.removed ? f.from : f.from_;
+        const baseindex base = u._array[from].base ();
+        uchar c = 0;
+        if (f.label < 0) {
+          if (d && ! f.removed) s.reserve (d), s.emit (d, _terminal (f.from), t._terminal (f.from_));
+          if (! (c = u._child (from, base)) && from) c = u._sibling (static_cast <size_t> (base ^ 0), from); // skip terminal
+        } else
+          c = u._sibling (static_cast <size_t> (base ^ f.label), from);
+        if (! c) {
+          if (f.removed) --n; else f.removed = true, f.label = -1;
+          continue;
+        }
+        f.label = c;
+        const uchar byte = u._decode[c];
+        s.reserve (d + 1);
+        s.key[d] = static_cast <char> (byte);
+        const size_t to = static_cast <size_t> (base ^ c);
+        if (f.removed) {
+          if (t._child_of (f.from_, byte) < 0) _diff_subtree (s, *this, to, d + 1, true);
+          continue;
+        }
+        const baseindex to_ = _child_of (f.from, byte);
+        if (to_ < 0) { _diff_subtree (s, t, to, d + 1, false); continue; }
+        if (REDUCED) {
+          const value_type v = _array[to_].value, v_ = t._array[to].value;
+          if (v >= 0 && v_ >= 0) { s.emit (d + 1, v, v_); continue; } // both leaves
+          if (v  >= 0) { _diff_subtree (s, t,     to, d + 1, false, "", 0, v);  continue; }
+          if (v_ >= 0) { _diff_subtree (s, *this, static_cast <size_t> (to_), d + 1, true, "", 0, v_); continue; }
+        }
+        if (n == capacity) _realloc_array (path, capacity << 1, static_cast <size_type> (capacity)), capacity <<= 1;
+        const _diff_frame next = { static_cast <size_t> (to_), to, -1, false };
+        path[n++] = next;
+      }
+      std::free (path);
+      return s.num;
+    }
+    // report the keys below node root (at depth) of trie u as removed (u is this trie) or added; a key of the other
+    // trie ending with suffix (of len_) and val, if given, is compared with them
+    template <typename V>
+    static void _diff_subtree (_diff_state <V>& s, const da& u, const size_t root, const size_t depth, const bool removed,
+                               const char* suffix = 0, const size_t len_ = 0, const value_type val = CEDAR_NO_VALUE) {
+      nodeelement b;
+      bool found = false;
+      size_t from (root), len (depth);
+      for (b.i = u.begin (from, len); b.i != CEDAR_NO_PATH && ! s.stop; b.i = u.next (from, len, root)) {
+        s.reserve (len);
+        u.suffix (s.key, len, from);
+        const bool same = suffix && len == depth + len_ && std::memcmp (s.key + depth, suffix, len_) == 0;
+        found |= same;
+        const value_type other = same ? val : static_cast <value_type> (CEDAR_NO_VALUE);
+        s.emit (len, removed ? b.x : other, removed ? other : b.x);
+      }
+      if (suffix && ! found) {
+        s.reserve (depth + len_);
+        std::memcpy (s.key + depth, suffix, len_);
+        s.emit (depth + len_, removed ? CEDAR_NO_VALUE : val, removed ? val : CEDAR_NO_VALUE);
+      }
+    }
+    // child of from by a key byte, or -1
+    baseindex _child_of (const size_t from, const uchar byte) const {
+      if (REDUCED && _array[from].value >= 0) return -1; // leaf
+      const baseindex base = _array[from].base ();
+      if (base < 0) return -1;
+      const size_t to = static_cast <size_t> (base ^ _code[byte]);
+      return _array[to].check == static_cast <checkindex> (from) ? static_cast <baseindex> (to) : -1;
+    }
+    // value of the key ending at from, or CEDAR_NO_VALUE
+    value_type _terminal (const size_t from) const {
+      if (REDUCED && _array[from].value >= 0) return _array[from].value;
+      const baseindex base = _array[from].base ();
+      if (base < 0 || _array[base ^ 0].check != static_cast <checkindex> (from)) return CEDAR_NO_VALUE;
+      return _array[base ^ 0].value;
+    }
     // find key from double array (can return -1 and -2 because CEDAR_NO_VALUE and CEDAR_NO_PATH)
     baseindex _find (const char* key, size_t& from, size_t& pos, const size_t len) const {
       for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; ) { // follow link
-#ifdef USE_REDUCED_TRIE
-        if (_array[from].value >= 0) break;
-#endif
-        size_t to = static_cast <size_t> (_array[from].base ()); to ^= key_[pos];
+        if (REDUCED && _array[from].value >= 0) break;
+        size_t to = static_cast <size_t> (_array[from].base ()); to ^= _code[key_[pos]];
         if (_array[to].check != static_cast <checkindex> (from)) return CEDAR_NO_PATH;
         ++pos;
         from = to;
       }
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value >= 0) // get value from leaf
-        return pos == len ? _array[from].value : CEDAR_NO_PATH; // only allow integer key  // XXX Here some cast needed on Non-integer value...
-#endif
+      if (REDUCED && _array[from].value >= 0) // get value from leaf
+        return pos == len ? static_cast <baseindex> (_array[from].value) : static_cast <baseindex> (CEDAR_NO_PATH); // only allow integer key  // XXX Here some cast needed on Non-integer value...
       const node n = _array[_array[from].base () ^ 0];
       if (n.check != static_cast <checkindex> (from)) return CEDAR_NO_VALUE;
-      return n.base ();
+      return n.base_; // value
     }
-    //
-#ifndef USE_FAST_LOAD
+    // first byte of the code of an id taking n bytes
+    static unsigned _id_head (const size_t n) { return 0x101 - (0x100u >> (n - 1)); }
+    // _find () for a sequence of ids; from is the node after the last id
+    baseindex _find_ids (const uint32_t* ids, const size_t n, size_t& from) const {
+      if (! n) return CEDAR_NO_PATH;
+      baseindex i = CEDAR_NO_PATH;
+      for (size_t j = 0; j < n; ++j) {
+        char key[MAX_ID_BYTES];
+        size_t pos = 0;
+        i = _find (key, from, pos, encode_id (ids[j], key));
+        if (i == CEDAR_NO_PATH) break;
+      }
+      return i;
+    }
+    // ninfo of a node; in the node itself with USE_COLOCATED_NINFO
+#ifdef USE_COLOCATED_NINFO
+    ninfo&       _info (const size_t i)       { return _array[i].info; }
+    const ninfo& _info (const size_t i) const { return _array[i].info; }
+    bool _has_ninfo () const { return true; }
+#else
+    ninfo&       _info (const size_t i)       { return _ninfo[i]; }
+    const ninfo& _info (const size_t i) const { return _ninfo[i]; }
+    bool _has_ninfo () const { return _ninfo; }
+#endif
+    // first child label of from (for the root, the first label following the terminal one)
+    uchar _child (const size_t from, const baseindex base) const {
+      if (_has_ninfo ())
+        return from ? _info (from).child : _info (base ^ _info (from).child).sibling;
+      return _probe (from, base, from ? 0 : 1);
+    }
+    // label of the right sibling of to (a child of from)
+    uchar _sibling (const size_t to, const size_t from) const {
+      if (_has_ninfo ()) return _info (to).sibling;
+      const baseindex base = _array[from].base ();
+      const int label = static_cast <int> (base ^ static_cast <baseindex> (to));
+      return label == 255 ? 0 : _probe (from, base, label + 1);
+    }
+    // ninfo-free enumeration of children for immutable (e.g., loaded) tries; labels come in ascending order
+    uchar _probe (const size_t from, const baseindex base, int label) const {
+      if (base >= 0)
+        for (; label < 256; ++label)
+          if (_array[base ^ label].check == static_cast <checkindex> (from))
+            return static_cast <uchar> (label);
+      return 0;
+    }
+    // also used by relayout () with FAST_LOAD
     void _restore_ninfo () {
+#ifdef USE_COLOCATED_NINFO
+      for (size_type i = 0; i < _size; ++i) _array[i].info = ninfo ();
+#else
       _realloc_array (_ninfo, static_cast<size_t>(_size));
+#endif
       for (size_type to = 0; to < _size; ++to) {
         const checkindex from = _array[to].check;
         if (from < 0) continue; // skip empty node
         const baseindex base = _array[from].base ();
         if (const uchar label = static_cast <uchar> (base ^ to)) // skip leaf
           _push_sibling (static_cast <size_t> (from), base, label,
-                         ! from || _ninfo[from].child || _array[base ^ 0].check == from);
+                         ! from || _info (from).child || _array[base ^ 0].check == from);
       }
     }
     //
@@ -580,12 +1683,313 @@ namespace cedar {
         block& b = _block[bi];
         b.num = 0;
         // e from the begining to the end of the actual block
-        for (; e < (bi << 8) + 256; ++e) if (_array[e].check < 0 && ++b.num == 1) b.ehead = e;
-        blockindex& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
+        for (; e < (bi << 8) + 256; ++e) {
+          if (_array[e].check < 0 && ++b.num == (bi ? 1 : 2)) b.ehead = e; // root (check = -1) is counted but not in the ring
+          _set_empty (e, e && _array[e].check < 0);
+        }
+        // block 0 stays Full as after _initialize (); it is never transferred, so its ehead would go stale
+        blockindex& head_out = ! bi || b.num == 0 ? _bheadF : (b.num == 1 ? _bheadC : _bheadO);
         _push_block (bi, head_out, ! head_out && b.num);
       }
     }
+    // node to which a key is associated; the terminal (label 0) or a leaf with value in the reduced trie
+    bool _is_leaf (const size_t to) const {
+      const node& n = _array[to];
+      return n.check >= 0 && (REDUCED ? n.value >= 0 : _array[n.check].base () == static_cast <baseindex> (to));
+    }
+    //
+    static size_t _popcount (uint64_t x) {
+#ifdef __GNUC__
+      return static_cast <size_t> (__builtin_popcountll (x));
+#else
+      size_t n = 0; for (; x; x &= x - 1) ++n; return n;
+#endif
+    }
+    // # trailing zeros; x != 0
+    static size_t _ctz (uint64_t x) {
+#ifdef __GNUC__
+      return static_cast <size_t> (__builtin_ctzll (x));
+#else
+      size_t n = 0; for (; ! (x & 1); x >>= 1) ++n; return n;
 #endif
+    }
+    // whether from may have children (not a terminal nor a leaf with value)
+    bool _has_child (const size_t from) const {
+      if (REDUCED) return _array[from].value < 0;
+      return ! from || (_array[_array[from].check].base () != static_cast <baseindex> (from) && _array[from].base () >= 0);
+    }
+    // occupancy of the array being built by relayout ()
+    struct _layout {
+      uint64_t* used;  // bitmap
+      short*    nfree; // # empty elements in a block
+      size_t*   next;  // next block that may have an empty element (union-find)
+      size_t    num_blocks;
+      explicit _layout (const size_t num_blocks_) : used (0), nfree (0), next (0), num_blocks (0)
+      { while (num_blocks < (num_blocks_ ? num_blocks_ : 1)) _add_block (); }
+      ~_layout () { std::free (used); std::free (nfree); std::free (next); }
+      bool used_at (const size_t e) const { return (used[e >> 6] >> (e & 63)) & 1; }
+      void use (const size_t e) {
+        used[e >> 6] |= static_cast <uint64_t> (1) << (e & 63);
+        if (! --nfree[e >> 8]) next[e >> 8] = (e >> 8) + 1;
+      }
+      // base to put labels at empty elements; searched from start
+      size_t find (const uchar* label, const short k, const size_t start) {
+        for (size_t bi = _next (start >> 8); ; bi = _next (bi + 1)) {
+          if (nfree[bi] < k) continue;
+          const uint64_t* const u = &used[bi << 2];
+          for (size_t w = bi == start >> 8 ? (start & 0xff) >> 6 : 0; w < 4; ++w) {
+            uint64_t e = ~u[w];
+            if (bi == start >> 8 && w == (start & 0xff) >> 6) e &= ~static_cast <uint64_t> (0) << (start & 63);
+            for (; e; e &= e - 1) {
+              const size_t base = ((bi << 8) | (w << 6) | _ctz (e)) ^ label[0];
+              if (base < 256) continue; // block 0 is for the root and its children; the root (check = -1) looks empty
+              short j = 1;
+              while (j < k && ! used_at (base ^ label[j])) ++j;
+              if (j == k) return base;
+            }
+          }
+        }
+      }
+    private:
+      _layout (const _layout&);
+      _layout& operator= (const _layout&);
+      size_t _next (const size_t bi) {
+        size_t r = bi;
+        while (r < num_blocks && next[r] != r) r = next[r];
+        if (r == num_blocks) _add_block ();
+        for (size_t x = bi; x != r; ) { const size_t y = next[x]; next[x] = r; x = y; } // compress
+        return r;
+      }
+      void _add_block () {
+        _realloc_array (used,  (num_blocks + 1) << 2, static_cast <size_type> (num_blocks << 2));
+        _realloc_array (nfree, num_blocks + 1, static_cast <size_type> (num_blocks));
+        _realloc_array (next,  num_blocks + 1, static_cast <size_type> (num_blocks));
+        nfree[num_blocks] = 256;
+        next[num_blocks] = num_blocks;
+        ++num_blocks;
+      }
+    };
+    struct _weight_counter {
+      size_t* weight;
+      void operator () (const size_t to) { ++weight[to]; }
+    };
+    // # leaves before to
+    baseindex _rank_leaf (const size_t to) const {
+      const rank_block& r = _rank[to >> 8];
+      size_t n = 0;
+      for (size_t i = 0; i < ((to & 0xff) >> 6); ++i) n += _popcount (r.leaf[i]);
+      n += _popcount (r.leaf[(to & 0xff) >> 6] & ((static_cast <uint64_t> (1) << (to & 63)) - 1));
+      return r.count + static_cast <baseindex> (n);
+    }
+    // id-th leaf; binary search for the last block with count <= id, then select in its bitmap
+    size_t _select_leaf (size_t id) const {
+      size_t lo (0), hi (static_cast <size_t> (_size) >> 8);
+      while (hi - lo > 1) {
+        const size_t mid = (lo + hi) >> 1;
+        if (static_cast <size_t> (_rank[mid].count) <= id) lo = mid; else hi = mid;
+      }
+      id -= static_cast <size_t> (_rank[lo].count);
+      size_t i = 0;
+      for (size_t n; id >= (n = _popcount (_rank[lo].leaf[i])); ++i) id -= n;
+      uint64_t x = _rank[lo].leaf[i];
+      while (id--) x &= x - 1;
+      size_t b = 0;
+      for (; ! (x & 1); x >>= 1) ++b;
+      return (lo << 8) | (i << 6) | b;
+    }
+    // append a record of [varint size][data] to the payload store
+    size_t _append_payload (const void* data, const size_t size) {
+      if (_payload_no_delete) { // copy on write
+        char* payload = 0;
+        _realloc_array (payload, _payload_size);
+        std::memcpy (payload, _payload, _payload_size);
+        _payload = payload;
+        _payload_no_delete = false;
+      }
+      if (_payload_quota < _payload_size + size + 10) {
+        const size_t quota = _payload_quota + _payload_quota;
+        _payload_quota = quota >= _payload_size + size + 10 ? quota : _payload_size + size + 10;
+        _realloc_array (_payload, _payload_quota, static_cast <size_type> (_payload_size));
+      }
+      const size_t offset = _payload_size;
+      size_t n = size;
+      do _payload[_payload_size++] = static_cast <char> ((n & 0x7f) | (n >> 7 ? 0x80 : 0)); while (n >>= 7);
+      std::memcpy (&_payload[_payload_size], data, size);
+      _payload_size += size;
+      return offset;
+    }
+    //
+    payload_type _read_payload (const size_t offset) const {
+      const uchar* p = reinterpret_cast <const uchar*> (&_payload[offset]);
+      size_t size = 0;
+      for (size_t shift = 0; ; shift += 7, ++p) {
+        size |= static_cast <size_t> (*p & 0x7f) << shift;
+        if (! (*p & 0x80)) break;
+      }
+      payload_type r = { reinterpret_cast <const char*> (p + 1), size };
+      return r;
+    }
+    //
+    /*
+     * <fn>.hdr, written by save () next to the array so that the array file stays what older versions read:
+     * a header, followed by the label map (256 bytes) if flags & 1. open () counts the keys by scan if the file
+     * is missing, or stale (size differs) after the array was saved by an older version.
+    */
+    struct header {
+      char     magic[4]; // "cdar"
+      uint32_t version;  // 1
+      uint32_t flags;
+      uint32_t reserved;
+      uint64_t size;     // # nodes in the array
+      uint64_t num_keys;
+      uint64_t nonzero_size;
+    };
+    int _save_header (const char* fn, const char* mode) const {
+      const char* const hdr = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".hdr");
+      FILE* fp = std::fopen (hdr, mode);
+      delete [] hdr;
+      if (! fp) return -1;
+      const header h = { { 'c', 'd', 'a', 'r' }, 1, _remapped ? 1u : 0u, 0,
+                         static_cast <uint64_t> (_size), static_cast <uint64_t> (_num_keys), static_cast <uint64_t> (_nonzero_size) };
+      std::fwrite (&h, sizeof (header), 1, fp);
+      if (_remapped) std::fwrite (_code, sizeof (uchar), 256, fp);
+      std::fclose (fp);
+      return 0;
+    }
+    int _open_header (const char* fn, const char* mode) {
+      const char* const hdr = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".hdr");
+      FILE* fp = std::fopen (hdr, mode);
+      delete [] hdr;
+      header h;
+      uchar code[256];
+      bool fresh = false;
+      if (fp) {
+        const bool read = std::fread (&h, sizeof (header), 1, fp) == 1 && ! std::memcmp (h.magic, "cdar", 4) && h.version == 1
+          && (! (h.flags & 1) || std::fread (code, sizeof (uchar), 256, fp) == 256);
+        std::fclose (fp);
+        if (! read) return -1;
+        fresh = h.size == static_cast <uint64_t> (_size);
+      }
+      _set_counter (fresh ? &h : 0);
+      if (fresh && (h.flags & 1)) _set_label_map (code);
+      return 0;
+    }
+    int _open_payload (const char* fn, const char* mode) {
+      const char* const pld = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".pld");
+      FILE* fp = std::fopen (pld, mode);
+      delete [] pld;
+      if (! fp) return 0; // no payload
+      const long end = std::fseek (fp, 0, SEEK_END) == 0 ? std::ftell (fp) : -1;
+      if (end < 0 || std::fseek (fp, 0, SEEK_SET) != 0) { std::fclose (fp); return -1; }
+      const size_t size = static_cast <size_t> (end);
+      _realloc_array (_payload, size);
+      const bool read = size == std::fread (_payload, sizeof (char), size, fp);
+      std::fclose (fp);
+      if (! read) return -1;
+      _payload_size = _payload_quota = size;
+      return 0;
+    }
+    // handles
+    size_t _hash_slot (const size_t from) const
+    { return static_cast <size_t> ((static_cast <uint64_t> (from) * 0x9e3779b97f4a7c15ULL) >> 32) & (_hslot_size - 1); }
+    size_t _find_slot (const size_t from) const { // slot of from or an empty slot to put it
+      size_t i = _hash_slot (from);
+      while (_hslot[i].head >= 0 && _hslot[i].node != from) i = (i + 1) & (_hslot_size - 1);
+      return i;
+    }
+    void _erase_slot (size_t i) { // backward shift deletion
+      for (size_t j = i; ; ) {
+        _hslot[i].head = -1;
+        for (;;) {
+          j = (j + 1) & (_hslot_size - 1);
+          if (_hslot[j].head < 0) { --_hslot_used; return; }
+          const size_t k = _hash_slot (_hslot[j].node);
+          if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) break; // j may fill i
+        }
+        _hslot[i] = _hslot[j];
+        i = j;
+      }
+    }
+    void _rehash_handles (const size_t n) {
+      handle_slot* const hslot = _hslot;
+      const size_t size = _hslot_size;
+      _hslot = 0;
+      _realloc_array (_hslot, n);
+      _hslot_size = n;
+      for (size_t i = 0; i < size; ++i)
+        if (hslot[i].head >= 0) _hslot[_find_slot (hslot[i].node)] = hslot[i];
+      std::free (hslot);
+    }
+    void _link_handle (const long h) {
+      if ((_hslot_used + 1) * 2 > _hslot_size) _rehash_handles (_hslot_size ? _hslot_size << 1 : 16);
+      handle_slot& s = _hslot[_find_slot (_handle[h].node)];
+      _handle[h].prev = -1;
+      if (s.head < 0) {
+        s.node = _handle[h].node;
+        _handle[h].next = -1;
+        ++_hslot_used;
+      } else {
+        _handle[h].next = s.head;
+        _handle[s.head].prev = h;
+      }
+      s.head = h;
+    }
+    void _unlink_handle (const long h) {
+      const handle_rec& r = _handle[h];
+      if (r.next >= 0) _handle[r.next].prev = r.prev;
+      if (r.prev >= 0) _handle[r.prev].next = r.next;
+      else {
+        const size_t i = _find_slot (r.node);
+        if (r.next >= 0) _hslot[i].head = r.next; else _erase_slot (i);
+      }
+    }
+    void _relink_handles () { // after node ids changed wholesale
+      for (size_t i = 0; i < _hslot_size; ++i) _hslot[i] = handle_slot ();
+      _hslot_used = 0;
+      for (size_t h = 0; h < _handle_size; ++h)
+        if (_handle[h].prev != -2) _link_handle (static_cast <long> (h));
+    }
+    void _move_handles (const size_t to_, const size_t to) { // handles on to_ go to to
+      const size_t i = _find_slot (to_);
+      const long head = _hslot[i].head;
+      if (head < 0) return;
+      _erase_slot (i);
+      long last = head;
+      for (long h = head; h >= 0; h = _handle[h].next) _handle[last = h].node = to;
+      handle_slot& s = _hslot[_find_slot (to)];
+      if (s.head < 0) {
+        s.node = to;
+        ++_hslot_used;
+      } else { // stale handles on to (e.g., an erased key)
+        _handle[last].next = s.head;
+        _handle[s.head].prev = last;
+      }
+      s.head = head;
+    }
+    //
+    void _clear_payload () {
+      if (_payload && ! _payload_no_delete) std::free (_payload);
+      _payload = 0;
+      _payload_size = _payload_quota = 0;
+      _payload_no_delete = false;
+    }
+    void _set_label_map (const uchar* code) {
+      _remapped = false;
+      _code[0] = _decode[0] = 0; // terminal
+      for (size_t c = 1; c < 256; ++c) _decode[c] = 0;
+      for (size_t c = 1; c < 256; ++c) {
+        const uchar l = code ? code[c] : static_cast <uchar> (c);
+        if (! l || _decode[l]) _err (__FILE__, __LINE__, "label map is not a permutation of 1..255\n");
+        _code[c] = l;
+        _decode[l] = static_cast <uchar> (c);
+        if (l != c) _remapped = true;
+      }
+    }
+    // take counters from the header saved with the array, or count them for an old file
+    void _set_counter (const header* h) {
+      _num_keys     = h ? static_cast <size_type> (h->num_keys)     : static_cast <size_type> (num_keys_by_scan ());
+      _nonzero_size = h ? static_cast <size_type> (h->nonzero_size) : static_cast <size_type> (nonzero_size_by_scan ());
+    }
     //
     void _set_result (result_type* x, value_type r, size_t = 0, size_t = 0) const
     { *x = r; }
@@ -620,49 +2024,26 @@ namespace cedar {
     }
     //
     blockindex _add_block () {
+#ifdef USE_COLOCATED_NINFO
+      if (_size > 0x7fffffff - 256)
+        _err (__FILE__, __LINE__, "too many nodes for USE_COLOCATED_NINFO (check is int)\n");
+#endif
       if (_size == _capacity) { // allocate memory if needed
-#ifdef USE_EXACT_FIT
-        _capacity += _size >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : _size;
+#ifdef USE_COLOCATED_NINFO
+        _capacity = GROWTH::grow (_size, _max_alloc, sizeof (node), sizeof (block));
 #else
-  #ifndef ALLOCATE_MEMORY_AT_ONCE
-        _capacity += _capacity; // Double capacity
-  #else
-        if (_max_alloc == 0) {
-          std::fprintf (stderr, "ERROR: Memory limit is not set or 0, but ALLOCATE_MEMORY_AT_ONCE is!\n");
+        _capacity = GROWTH::grow (_size, _max_alloc, sizeof (node) + sizeof (ninfo), sizeof (block));
+#endif
+        if (_capacity <= _size) {
+          std::fprintf (stderr, "ERROR: Memory limit is not set or too low (size, max memory: %zu, %zu)\n",
+                        static_cast<size_t>(_size), _max_alloc);
           std::free (_array); std::free (_ninfo); std::free (_block);
           std::exit (1);
         }
-  #endif
-        size_t desired_alloc = sizeof(*_array) * static_cast<size_t>(_capacity) +
-                               sizeof(*_ninfo) * static_cast<size_t>(_capacity) +
-                               sizeof(*_ninfo) * (static_cast<size_t>(_capacity) >> 8);
-  #ifndef ALLOCATE_MEMORY_AT_ONCE
-        if (_max_alloc > 0 and desired_alloc > _max_alloc) {  // Doubling capacity is too mutch!
-            _capacity = _size;                              // Go back to current capacity and grow it!
-
-  #else
-        if (_max_alloc > 0 and desired_alloc < _max_alloc) {  // Current capacity is less than maxium
-                                                            // Grow it!
-  #endif
-
-            while (desired_alloc < _max_alloc) {
-                _capacity += 256;
-                desired_alloc = sizeof(*_array) * static_cast<size_t>(_capacity) +
-                                sizeof(*_ninfo) * static_cast<size_t>(_capacity) +
-                                sizeof(*_ninfo) * (static_cast<size_t>(_capacity) >> 8);
-            }
-              _capacity -= 256;  // Return to the last good value
-              if (_size >= _capacity) {
-                  std::fprintf (stderr,
-                                "ERROR: Memory limit too low (last capacity [desired capacity], max memory [desired memory]: %zu [%zu], %zu [%zu]\n",
-                                static_cast<size_t>(_size), static_cast<size_t>(_capacity), _max_alloc, desired_alloc);
-                  std::free (_array); std::free (_ninfo); std::free (_block);
-                  std::exit (1);
-              }
-        }
-#endif
         _realloc_array (_array, static_cast<size_t>(_capacity), _capacity);
+#ifndef USE_COLOCATED_NINFO
         _realloc_array (_ninfo, static_cast<size_t>(_capacity), _size);
+#endif
         _realloc_array (_block, static_cast<size_t>(_capacity) >> 8, _size >> 8); // _capacity / 256, _size / 256 to match blocksize == 256
       }
       _block[_size >> 8].ehead = _size;
@@ -681,9 +2062,11 @@ namespace cedar {
     // pop empty node from block; never transfer the special block (bi = 0) // XXX Create place for an empty node?
     baseindex _pop_enode (const baseindex base, const uchar label, const checkindex from) {
       const baseindex e  = base < 0 ? _find_place () : base ^ label;
+      ++_nonzero_size;
       const blockindex bi = e >> 8;
       node&  n = _array[e];
       block& b = _block[bi];
+      _set_empty (e, false);
       if (--b.num == 0) {  // If block is Closed, transfer to Full...
         if (bi) _transfer_block (bi, _bheadC, _bheadF); // Closed to Full
       } else { // release empty node from empty ring
@@ -693,20 +2076,18 @@ namespace cedar {
         if (bi && b.num == 1 && b.trial != MAX_TRIAL) _transfer_block (bi, _bheadO, _bheadC); // Open to Closed
       }
       // initialize the released node
-#ifdef USE_REDUCED_TRIE
-      n.value = CEDAR_VALUE_LIMIT; n.check = from;
-      if (base < 0) _array[from].base_ = - (e ^ label) - 1;
-#else
-      if (label) n.base_ = -1; else n.value = value_type (0); n.check = from;  // XXX is this ok? Else 2 statement in one block?
-      if (base < 0) _array[from].base_ = e ^ label;
-#endif
+      if (REDUCED) n.base_ = 0, n.value = CEDAR_VALUE_LIMIT; // clear the bits of base_ above value
+      else if (label) n.base_ = -1; else n.value = value_type (0);
+      n.check = from;
+      if (base < 0) _array[from].base_ = REDUCED ? - (e ^ label) - 1 : e ^ label;
       return e;
     }
     // push empty node into empty ring
     void _push_enode (const baseindex e) {
       const blockindex bi = e >> 8;
+      --_nonzero_size;
       block& b = _block[bi];
-      if (++b.num == 1) { // Full to Closed
+      if (++b.num == (bi ? 1 : 2)) { // Full to Closed (block 0 also counts the root)
         b.ehead = e;
         _array[e] = node (-e, -e);
         if (bi) _transfer_block (bi, _bheadF, _bheadC); // Full to Closed
@@ -719,35 +2100,36 @@ namespace cedar {
         b.trial = 0;
       }
       if (b.reject < _reject[b.num]) b.reject = _reject[b.num];
-      _ninfo[e] = ninfo (); // reset ninfo; no child, no sibling
+      _set_empty (e, true);
+      _info (e) = ninfo (); // reset ninfo; no child, no sibling
     }
     // push label to from's child
     void _push_sibling (const size_t from, const baseindex base, const uchar label, const bool flag = true) {
-      uchar* c = &_ninfo[from].child;
+      uchar* c = &_info (from).child;
       if (flag && (ORDERED ? label > *c : ! *c))
-        do c = &_ninfo[base ^ *c].sibling; while (ORDERED && *c && *c < label);
-      _ninfo[base ^ label].sibling = *c, *c = label;
+        do c = &_info (base ^ *c).sibling; while (ORDERED && *c && *c < label);
+      _info (base ^ label).sibling = *c, *c = label;
     }
     // pop label from from's child
     void _pop_sibling (const size_t from, const baseindex base, const uchar label) {
-      uchar* c = &_ninfo[from].child;
-      while (*c != label) c = &_ninfo[base ^ *c].sibling;
-      *c = _ninfo[base ^ label].sibling;
+      uchar* c = &_info (from).child;
+      while (*c != label) c = &_info (base ^ *c).sibling;
+      *c = _info (base ^ label).sibling;
     }
     // check whether to replace branching w/ the newly added node
     bool _consult (const baseindex base_n, const baseindex base_p, uchar c_n, uchar c_p) const {
       //
-      do c_n = _ninfo[base_n ^ c_n].sibling, c_p = _ninfo[base_p ^ c_p].sibling; // XXX is this ok? , instead of ; ?
+      do c_n = _info (base_n ^ c_n).sibling, c_p = _info (base_p ^ c_p).sibling; // XXX is this ok? , instead of ; ?
       while (c_n && c_p);
       return c_p;
     }
     // enumerate (equal to or more than one) child nodes
     uchar* _set_child (uchar* p, const baseindex base, uchar c, const int label = -1) {  // label is a type of uchar uchar if set...
       --p;
-      if (! c)  { *++p = c; c = _ninfo[base ^ c].sibling; } // 0: terminal
-      if (ORDERED) while (c && c < label) { *++p = c; c = _ninfo[base ^ c].sibling; }
+      if (! c)  { *++p = c; c = _info (base ^ c).sibling; } // 0: terminal
+      if (ORDERED) while (c && c < label) { *++p = c; c = _info (base ^ c).sibling; }
       if (label != -1) *++p = static_cast <uchar> (label);
-      while (c) { *++p = c; c = _ninfo[base ^ c].sibling; }
+      while (c) { *++p = c; c = _info (base ^ c).sibling; }
       return p;
     }
     // explore new block to settle down
@@ -763,13 +2145,19 @@ namespace cedar {
         const short nc = static_cast <short> (last - first + 1);
         while (1) { // set candidate block
           block& b = _block[bi];
-          if (b.num >= nc && nc < b.reject) // explore configuration
+          if (b.num >= nc && nc < b.reject) { // explore configuration
+#ifdef USE_RING_FIND_PLACE
             for (blockindex e = b.ehead;;) {
               const baseindex base = e ^ *first;
               for (const uchar* p = first; _array[base ^ *++p].check < 0; )
                 if (p == last) return b.ehead = e; // no conflict
               if ((e = - _array[e].check) == b.ehead) break;
             }
+#else
+            const baseindex e = _find_empty (bi, first, last);
+            if (e >= 0) return b.ehead = e; // no conflict
+#endif
+          }
           b.reject = nc;
           if (b.reject < _reject[b.num]) _reject[b.num] = b.reject;
           const blockindex bi_ = b.next; // This const's lifetime is the end of the scope in each loop
@@ -780,6 +2168,77 @@ namespace cedar {
       }
       return _add_block () << 8;
     }
+#ifndef USE_RING_FIND_PLACE
+    // first empty element e in block bi (from ehead) such that e ^ *first ^ *p is empty for all p in [first, last]; -1 if none
+    baseindex _find_empty (const blockindex bi, const uchar* const first, const uchar* const last) const {
+      const block& b = _block[bi];
+      const size_t h = static_cast <size_t> (b.ehead) & 0xff;
+#ifdef __AVX2__
+      const __m256i empty = _mm256_loadu_si256 (reinterpret_cast <const __m256i*> (b.empty));
+      __m256i m = empty;
+      for (const uchar* p = first; p != last; ) {
+        m = _mm256_and_si256 (m, _xor_index (empty, *first ^ *++p)); // empty[e ^ (*first ^ *p)]
+        if (_mm256_testz_si256 (m, m)) return -1;
+      }
+      uint64_t c[4];
+      _mm256_storeu_si256 (reinterpret_cast <__m256i*> (c), m);
+      for (size_t i = 0; i <= 4; ++i) { // from ehead, wrapping around
+        const size_t w = ((h >> 6) + i) & 3;
+        const uint64_t x = i ? c[w] : c[w] & (~static_cast <uint64_t> (0) << (h & 63));
+        if (x) return static_cast <baseindex> ((bi << 8) | static_cast <blockindex> ((w << 6) | _ctz (x)));
+      }
+#else // test each empty element from ehead as the ring walk does, but on the bitmap
+      for (size_t i = 0; i <= 4; ++i) {
+        const size_t w = ((h >> 6) + i) & 3;
+        for (uint64_t x = i ? b.empty[w] : b.empty[w] & (~static_cast <uint64_t> (0) << (h & 63)); x; x &= x - 1) {
+          const size_t base = ((w << 6) | _ctz (x)) ^ *first;
+          const uchar* p = first;
+          while (p != last && (b.empty[(base ^ p[1]) >> 6] >> ((base ^ p[1]) & 63) & 1)) ++p;
+          if (p == last) return static_cast <baseindex> ((bi << 8) | static_cast <blockindex> (base ^ *first));
+        }
+      }
+#endif
+      return -1;
+    }
+#ifdef __AVX2__
+    // element i of the result is element (i ^ d) of the 256-bit x
+    static __m256i _xor_index (const __m256i x, const uchar d) {
+      // bit k of a byte -> bit (k ^ (d & 7)) for the lower and upper half bytes
+#define CEDAR_BIT(n, k, d) ((((n) >> (k)) & 1) << (((k) ^ (d)) & 7))
+#define CEDAR_NIBBLE(n, o, d) static_cast <char> (CEDAR_BIT (n, o, d) | CEDAR_BIT (n, o + 1, d) | CEDAR_BIT (n, o + 2, d) | CEDAR_BIT (n, o + 3, d))
+#define CEDAR_ROW(o, d) { CEDAR_NIBBLE ( 0 << o, o, d), CEDAR_NIBBLE ( 1 << o, o, d), CEDAR_NIBBLE ( 2 << o, o, d), CEDAR_NIBBLE ( 3 << o, o, d), \
+                          CEDAR_NIBBLE ( 4 << o, o, d), CEDAR_NIBBLE ( 5 << o, o, d), CEDAR_NIBBLE ( 6 << o, o, d), CEDAR_NIBBLE ( 7 << o, o, d), \
+                          CEDAR_NIBBLE ( 8 << o, o, d), CEDAR_NIBBLE ( 9 << o, o, d), CEDAR_NIBBLE (10 << o, o, d), CEDAR_NIBBLE (11 << o, o, d), \
+                          CEDAR_NIBBLE (12 << o, o, d), CEDAR_NIBBLE (13 << o, o, d), CEDAR_NIBBLE (14 << o, o, d), CEDAR_NIBBLE (15 << o, o, d) }
+      static const char bit[2][8][16] = {
+        { CEDAR_ROW (0, 0), CEDAR_ROW (0, 1), CEDAR_ROW (0, 2), CEDAR_ROW (0, 3), CEDAR_ROW (0, 4), CEDAR_ROW (0, 5), CEDAR_ROW (0, 6), CEDAR_ROW (0, 7) },
+        { CEDAR_ROW (4, 0), CEDAR_ROW (4, 1), CEDAR_ROW (4, 2), CEDAR_ROW (4, 3), CEDAR_ROW (4, 4), CEDAR_ROW (4, 5), CEDAR_ROW (4, 6), CEDAR_ROW (4, 7) } };
+#undef CEDAR_ROW
+#undef CEDAR_NIBBLE
+#undef CEDAR_BIT
+      const __m256i dword = _mm256_xor_si256 (_mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32 ((d >> 6) << 1));
+      const __m256i byte  = _mm256_xor_si256 (_mm256_setr_epi8 (0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                                                0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                              _mm256_set1_epi8 (static_cast <char> ((d >> 3) & 7)));
+      const __m256i y  = _mm256_shuffle_epi8 (_mm256_permutevar8x32_epi32 (x, dword), byte); // word (d >> 6), byte (d >> 3)
+      const __m256i lo = _mm256_set1_epi8 (0x0f);
+      const __m256i t0 = _mm256_broadcastsi128_si256 (_mm_loadu_si128 (reinterpret_cast <const __m128i*> (bit[0][d & 7])));
+      const __m256i t1 = _mm256_broadcastsi128_si256 (_mm_loadu_si128 (reinterpret_cast <const __m128i*> (bit[1][d & 7])));
+      return _mm256_or_si256 (_mm256_shuffle_epi8 (t0, _mm256_and_si256 (y, lo)),
+                              _mm256_shuffle_epi8 (t1, _mm256_and_si256 (_mm256_srli_epi16 (y, 4), lo)));
+    }
+#endif
+#endif
+    // mark e in (or out of) the empty ring of its block
+    void _set_empty (const size_t e, const bool empty) {
+#ifndef USE_RING_FIND_PLACE
+      uint64_t& w = _block[e >> 8].empty[(e & 0xff) >> 6];
+      const uint64_t bit = static_cast <uint64_t> (1) << (e & 63);
+      if (empty) w |= bit; else w &= ~bit;
+#else
+      (void) e; (void) empty;
+#endif
+    }
     // resolve conflict on base_n ^ label_n = base_p ^ label_p
     template <typename T>
     baseindex _resolve (size_t& from_n, const baseindex base_n, const uchar label_n, T& cf) {
@@ -788,63 +2247,54 @@ namespace cedar {
       const checkindex from_p = _array[to_pn].check;
       const baseindex base_p = _array[from_p].base ();
       const bool flag // whether to replace siblings of newly added
-        = _consult (base_n, base_p, _ninfo[from_n].child, _ninfo[from_p].child);
+        = _consult (base_n, base_p, _info (from_n).child, _info (from_p).child);
       uchar child[256];
       uchar* const first = &child[0];
       uchar* const last  =
-        flag ? _set_child (first, base_n, _ninfo[from_n].child, label_n)
-        : _set_child (first, base_p, _ninfo[from_p].child);
+        flag ? _set_child (first, base_n, _info (from_n).child, label_n)
+        : _set_child (first, base_p, _info (from_p).child);
       const baseindex base = (first == last ? _find_place () : _find_place (first, last)) ^ *first;
       // replace & modify empty list
       const checkindex from  = flag ? static_cast <checkindex> (from_n) : from_p;
       const baseindex base_  = flag ? base_n : base_p;
-      if (flag && *first == label_n) _ninfo[from].child = label_n; // new child
-#ifdef USE_REDUCED_TRIE
-      _array[from].base_ = -base - 1; // new base
-#else
-      _array[from].base_ = base; // new base
-#endif
+      if (flag && *first == label_n) _info (from).child = label_n; // new child
+      _array[from].base_ = REDUCED ? -base - 1 : base; // new base
       for (const uchar* p = first; p <= last; ++p) { // to_ => to
         const baseindex to  = _pop_enode (base, *p, from);
         const baseindex to_ = base_ ^ *p;
 
-        if (p == last) _ninfo[to].sibling = 0;  // This is more readable
-        else _ninfo[to].sibling = *(p + 1);
+        if (p == last) _info (to).sibling = 0;  // This is more readable
+        else _info (to).sibling = *(p + 1);
 
         if (flag && to_ == to_pn) continue; // skip newcomer (no child)
         cf (to_, to); // user-defined callback function to handle moved nodes
         node& n  = _array[to];
         node& n_ = _array[to_];
-#ifdef USE_REDUCED_TRIE
-        if ((n.base_ = n_.base_) < 0 && *p) // copy base; bug fix
-#else
-        if ((n.base_ = n_.base_) > 0 && *p) // copy base; bug fix
-#endif
+        if ((REDUCED ? (n.base_ = n_.base_) < 0 : (n.base_ = n_.base_) > 0) && *p) // copy base; bug fix
           {
-            uchar c = _ninfo[to].child = _ninfo[to_].child;
+            uchar c = _info (to).child = _info (to_).child;
             do _array[n.base () ^ c].check = to; // adjust grand son's check
-            while ((c = _ninfo[n.base () ^ c].sibling));
+            while ((c = _info (n.base () ^ c).sibling));
           }
         if (! flag && to_ == static_cast <baseindex> (from_n)) // parent node moved
           from_n = static_cast <size_t> (to); // bug fix
         if (! flag && to_ == to_pn) { // the address is immediately used
           _push_sibling (from_n, to_pn ^ label_n, label_n);
-          _ninfo[to_].child = 0; // remember to reset child
-#ifdef USE_REDUCED_TRIE
-          n_.value = CEDAR_VALUE_LIMIT;
-#else
-          if (label_n) n_.base_ = -1; else n_.value = value_type (0);
-#endif
+          _info (to_).child = 0; // remember to reset child
+          if (REDUCED) n_.base_ = 0, n_.value = CEDAR_VALUE_LIMIT;
+          else if (label_n) n_.base_ = -1; else n_.value = value_type (0);
           n_.check = static_cast <checkindex> (from_n);
         } else
           _push_enode (to_);
-        if (NUM_TRACKING_NODES) // keep the traversed node updated
-          for (size_t j = 0; tracking_node[j] != 0; ++j)
-            if (tracking_node[j] == static_cast <size_t> (to_))
-              { tracking_node[j] = static_cast <size_t> (to); break; }
+        if (_num_handles) _move_handles (static_cast <size_t> (to_), static_cast <size_t> (to));
       }
       return flag ? base ^ label_n : to_pn;
     }
   };
+  // the variants of cedar.h as distinct types
+  template <typename value_type_>
+  using trie = da <value_type_, NaN <value_type_>::N1, NaN <value_type_>::N2, true, 1, false>;
+  template <typename value_type_>
+  using reduced_trie = da <value_type_, NaN <value_type_>::N1, NaN <value_type_>::N2, true, 1, true>;
 }
 #endif
@@ -0,0 +1,141 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//
+//  Longest-prefix-match (LPM) mode for routing and ACL tables on top of cedar::da.
+//  #include <cedar.h> (or <cedarpp.h>) before this file.
+//
+//  A prefix is a bit string (an IPv4 or IPv6 address in network byte order and a length in bits).
+//  Keys are encoded a nibble per byte as 1 + nibble, so that they never include '\0'. A prefix
+//  whose length is not a multiple of four is expanded to all the nibbles it covers at its last
+//  position (/19 -> two 5-nibble keys; at most eight keys per prefix, except /0 -> sixteen 1-nibble
+//  keys since the root holds no value), and the most specific prefix wins a key shared with others.
+//  The value stored for an expanded key is (value << 8 | length).
+//  The prefixes themselves are also stored as [full nibbles][17 + remaining bits] (never on the
+//  path of an address) so that erase() can restore the expanded keys of shorter prefixes.
+//  Then longestPrefixMatch() is a single common prefix search of the encoded address.
+//
+#ifndef CEDAR_LPM_H
+#define CEDAR_LPM_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h> //uint32_t
+
+namespace cedar {
+  // LPM table; values must be in [0, 2^(8 * sizeof (value_type) - 9))
+  template <typename trie_t>
+  class lpm {
+  public:
+    typedef typename trie_t::value_type value_type;
+    enum { MAX_BITS = 128, NO_ROUTE = -1 };
+    lpm () : _t () {}
+    // Insert (or overwrite) prefix of length len (in bits) with value
+    void insert (const unsigned char* prefix, const size_t len, const value_type value) {
+      char key[MAX_BITS / 4 + 1];
+      _t.update (key, _registry_key (prefix, len, key)) = value;
+      const size_t last = _last (len);
+      _encode (prefix, last * 4, key);
+      for (size_t i = 0, n = _num_slots (len); i < n; ++i) {
+        key[last - 1] = static_cast <char> (1 + (_fixed_nibble (prefix, len) | i));
+        const value_type r = _t.template exactMatchSearch <value_type> (key, last);
+        if (r == trie_t::CEDAR_NO_VALUE || static_cast <size_t> (r & 0xff) <= len) // keep more specific one
+          _t.update (key, last) = (value << 8) | static_cast <value_type> (len);
+      }
+    }
+    // Erase prefix of length len; returns -1 if the prefix is not in the table
+    int erase (const unsigned char* prefix, const size_t len) {
+      char key[MAX_BITS / 4 + 1];
+      if (_t.erase (key, _registry_key (prefix, len, key)) != 0) return -1;
+      const size_t last = _last (len);
+      const size_t lower = last == 1 ? 0 : (last - 1) * 4 + 1; // shortest prefix sharing the keys
+      unsigned char slot[MAX_BITS / 8];
+      for (size_t i = 0, n = _num_slots (len); i < n; ++i) {
+        _encode (prefix, last * 4, key);
+        key[last - 1] = static_cast <char> (1 + (_fixed_nibble (prefix, len) | i));
+        const value_type r = _t.template exactMatchSearch <value_type> (key, last);
+        if (r == trie_t::CEDAR_NO_VALUE || static_cast <size_t> (r & 0xff) != len) continue;
+        _decode (key, last, slot);
+        value_type v = NO_ROUTE;
+        size_t len_ = len;
+        while (len_-- > lower) { // find the most specific prefix covering the key
+          char key_[MAX_BITS / 4 + 1];
+          v = _t.template exactMatchSearch <value_type> (key_, _registry_key (slot, len_, key_));
+          if (v != trie_t::CEDAR_NO_VALUE) break;
+        }
+        if (v == trie_t::CEDAR_NO_VALUE || v == NO_ROUTE) _t.erase (key, last);
+        else _t.update (key, last) = (v << 8) | static_cast <value_type> (len_);
+      }
+      return 0;
+    }
+    // Returns the value of the most specific prefix of addr (bits long) or NO_ROUTE; len gets its length
+    value_type longestPrefixMatch (const unsigned char* addr, const size_t bits = 32, size_t* len = 0) const {
+      char key[MAX_BITS / 4];
+      const size_t n = bits / 4;
+      _encode (addr, n * 4, key);
+      value_type v = NO_ROUTE;
+      _t.commonPrefixVisit (key, n, _longest (v));
+      if (len) *len = v == NO_ROUTE ? 0 : static_cast <size_t> (v & 0xff);
+      return v == NO_ROUTE ? v : v >> 8;
+    }
+    // IPv4 versions; addresses in host byte order
+    void insert (const uint32_t prefix, const size_t len, const value_type value)
+    { unsigned char p[4]; insert (_ipv4 (prefix, p), len, value); }
+    int erase (const uint32_t prefix, const size_t len)
+    { unsigned char p[4]; return erase (_ipv4 (prefix, p), len); }
+    value_type longestPrefixMatch (const uint32_t addr, size_t* len = 0) const
+    { unsigned char p[4]; return longestPrefixMatch (_ipv4 (addr, p), 32, len); }
+    //
+    const trie_t& trie () const { return _t; }
+    trie_t&       trie ()       { return _t; }
+  private:
+    // currently disabled; implement these if you need
+    lpm (const lpm&);
+    lpm& operator= (const lpm&);
+    trie_t _t;
+    //
+    struct _longest { // keeps the last (longest) match
+      value_type& v;
+      explicit _longest (value_type& v_) : v (v_) {}
+      template <typename id_t>
+      bool operator () (const value_type v_, size_t, id_t) { v = v_; return true; }
+    };
+    static void _err (const char* fn, const int ln, const char* msg)
+    { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
+    static const unsigned char* _ipv4 (const uint32_t a, unsigned char* p) {
+      p[0] = static_cast <unsigned char> (a >> 24); p[1] = static_cast <unsigned char> (a >> 16);
+      p[2] = static_cast <unsigned char> (a >> 8);  p[3] = static_cast <unsigned char> (a);
+      return p;
+    }
+    static unsigned _nibble (const unsigned char* p, const size_t i)
+    { return i & 1 ? p[i >> 1] & 0xf : p[i >> 1] >> 4; }
+    // write the first bits (a multiple of four) of p to key as nibbles
+    static void _encode (const unsigned char* p, const size_t bits, char* key) {
+      if (bits > MAX_BITS) _err (__FILE__, __LINE__, "prefix is too long\n");
+      for (size_t i = 0; i < bits / 4; ++i) key[i] = static_cast <char> (1 + _nibble (p, i));
+    }
+    static void _decode (const char* key, const size_t n, unsigned char* p) {
+      for (size_t i = 0; i < n; ++i) {
+        const unsigned c = static_cast <unsigned> (key[i] - 1);
+        if (i & 1) p[i >> 1] = static_cast <unsigned char> (p[i >> 1] | c); else p[i >> 1] = static_cast <unsigned char> (c << 4);
+      }
+    }
+    // # nibbles of the (expanded) keys of a prefix of length len
+    static size_t _last (const size_t len) { return len ? (len + 3) / 4 : 1; }
+    static size_t _num_slots (const size_t len) { return static_cast <size_t> (1) << (_last (len) * 4 - len); }
+    // the fixed (upper) bits of the last nibble of a prefix
+    static unsigned _fixed_nibble (const unsigned char* prefix, const size_t len) {
+      const size_t last = _last (len), free = last * 4 - len;
+      return len ? (_nibble (prefix, last - 1) >> free) << free : 0;
+    }
+    // key for the prefix itself; [full nibbles][17 + (1 << remaining bits) - 1 + the bits]
+    static size_t _registry_key (const unsigned char* prefix, const size_t len, char* key) {
+      if (len > MAX_BITS) _err (__FILE__, __LINE__, "prefix is too long\n");
+      const size_t n = len / 4, r = len % 4;
+      _encode (prefix, n * 4, key);
+      const unsigned bits = r ? _nibble (prefix, n) >> (4 - r) : 0;
+      key[n] = static_cast <char> (16 + (1u << r) + bits);
+      return n + 1;
+    }
+  };
+}
+#endif
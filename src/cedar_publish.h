@@ -0,0 +1,215 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//
+//  Hot-swap publication of rebuilt tries with epoch-based reclamation.
+//  #include <cedar.h> (or <cedarpp.h>) before this file; needs C++11 atomics and POSIX mmap ().
+//
+//  A writer builds (or loads) a new trie off-line and publish ()-es it; readers switch to it at
+//  their next acquire () without taking a lock. Each reader owns a slot on its own cache line and
+//  announces there the global epoch it entered in, so acquire () and release () write no shared
+//  cache line. publish () swaps the current instance, advances the epoch and retires the old one;
+//  a retired instance is destroyed by reclaim () once no slot announces an epoch older than its
+//  retirement (readers still inside it). publish_file () loads a trie by open () and
+//  publish_mapped () maps a saved trie read-only by mmap () + set_array (); the mapping is unmapped
+//  together with the instance. Replace a mapped file (and its .hdr) by rename (), never by rewriting it in place.
+//
+//    cedar::publisher <cedar::da <int> > pub;
+//    pub.publish_mapped ("dic");                   // writer
+//    cedar::publisher <cedar::da <int> >::reader r (pub); // one per reader thread
+//    { cedar::publisher <cedar::da <int> >::guard g (r);
+//      g->exactMatchSearch <int> (key, len); }      // a consistent trie until the guard is gone
+//
+#ifndef CEDAR_PUBLISH_H
+#define CEDAR_PUBLISH_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h> //uint64_t
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <thread> //std::this_thread::yield
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cedar {
+  template <typename trie_t>
+  class publisher {
+    struct slot;
+    struct instance;
+  public:
+    enum { CACHE_LINE = 64, MAX_READERS = 64 };
+    class reader;
+    class guard;
+    explicit publisher (const size_t max_readers = MAX_READERS) : _slot (0), _num_slots (max_readers), _current (0), _epoch (1), _retired (0), _num_retired (0) {
+      void* p = 0;
+      if (! _num_slots || ::posix_memalign (&p, CACHE_LINE, sizeof (slot) * _num_slots) != 0)
+        _err (__FILE__, __LINE__, "memory allocation failed\n");
+      _slot = static_cast <slot*> (p);
+      for (size_t i = 0; i < _num_slots; ++i) new (&_slot[i]) slot ();
+    }
+    // readers must be gone
+    ~publisher () {
+      _dispose (_current.load (std::memory_order_relaxed));
+      while (_retired) { instance* next = _retired->next; _dispose (_retired); _retired = next; }
+      for (size_t i = 0; i < _num_slots; ++i) _slot[i].~slot ();
+      std::free (_slot);
+    }
+    // writer side
+    /*
+     * Publish a trie (allocated by new) and take its ownership; the previous one is retired and
+     * destroyed when its readers finish. Returns the number of instances still waiting for readers.
+    */
+    size_t publish (trie_t* t) { return _publish (_make (t)); }
+    // load by open () and publish; returns -1 if the file cannot be read
+    int publish_file (const char* fn, const char* mode = "rb") {
+      trie_t* t = new trie_t;
+      if (t->open (fn, mode) != 0) { delete t; return -1; }
+      publish (t);
+      return 0;
+    }
+    // map the file (and <fn>.pld if any) read-only and publish; the counters and label map come from <fn>.hdr.
+    // returns -1 if the files cannot be mapped or read
+    int publish_mapped (const char* fn) {
+      instance* p = _make (new trie_t);
+      if (_map (fn, p->map[0], p->map_size[0]) != 0 ||
+          p->t->set_array (p->map[0], p->map_size[0] / p->t->unit_size (), fn) != 0)
+        { _dispose (p); return -1; }
+      const char* const pld = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".pld");
+      const int ret = ::access (pld, F_OK) == 0 ? _map (pld, p->map[1], p->map_size[1]) : 0;
+      delete [] pld;
+      if (ret != 0) { _dispose (p); return -1; }
+      if (p->map[1]) p->t->set_payload_array (p->map[1], p->map_size[1]);
+      _publish (p);
+      return 0;
+    }
+    // destroy retired instances no reader can see; returns the number of the remaining ones
+    size_t reclaim () {
+      std::lock_guard <std::mutex> lock (_mutex);
+      return _reclaim ();
+    }
+    // wait for the readers of all the retired instances
+    void synchronize () { while (reclaim ()) std::this_thread::yield (); }
+    size_t   retired () const { std::lock_guard <std::mutex> lock (_mutex); return _num_retired; }
+    uint64_t epoch   () const { return _epoch.load (std::memory_order_acquire); }
+    // reader side; one per thread, not shared
+    class reader {
+    public:
+      explicit reader (publisher& p) : _p (p), _s (0) {
+        for (size_t i = 0; i < p._num_slots && ! _s; ++i) {
+          bool used = false;
+          if (! p._slot[i].used.load (std::memory_order_relaxed) &&
+              p._slot[i].used.compare_exchange_strong (used, true, std::memory_order_acquire))
+            _s = &p._slot[i];
+        }
+        if (! _s) _err (__FILE__, __LINE__, "too many readers\n");
+      }
+      ~reader () { release (); _s->used.store (false, std::memory_order_release); }
+      // enter the current epoch; the trie is valid until release ()
+      const trie_t* acquire () {
+        _s->epoch.store (_p._epoch.load (std::memory_order_acquire), std::memory_order_seq_cst);
+        const instance* p = _p._current.load (std::memory_order_seq_cst); // after the epoch is visible
+        return p ? p->t : 0;
+      }
+      void release () { _s->epoch.store (0, std::memory_order_release); }
+    private:
+      publisher& _p;
+      slot*      _s;
+      reader (const reader&);
+      reader& operator= (const reader&);
+    };
+    class guard { // acquire () ... release () in a scope
+    public:
+      explicit guard (reader& r) : _r (r), _t (r.acquire ()) {}
+      ~guard () { _r.release (); }
+      const trie_t* get        () const { return _t; }
+      const trie_t* operator-> () const { return _t; }
+      const trie_t& operator*  () const { return *_t; }
+    private:
+      reader&       _r;
+      const trie_t* _t;
+      guard (const guard&);
+      guard& operator= (const guard&);
+    };
+  private:
+    struct slot { // epoch the reader entered in (0 if outside); one cache line each
+      std::atomic <uint64_t> epoch;
+      std::atomic <bool>     used;
+      char pad[CACHE_LINE - sizeof (std::atomic <uint64_t>) - sizeof (std::atomic <bool>)];
+      slot () : epoch (0), used (false) {}
+    };
+    struct instance {
+      trie_t*   t;
+      void*     map[2]; // trie and payload mapped by publish_mapped ()
+      size_t    map_size[2];
+      uint64_t  epoch; // retired at
+      instance* next;
+    };
+    slot*                    _slot;
+    size_t                   _num_slots;
+    std::atomic <instance*>  _current;
+    std::atomic <uint64_t>   _epoch;
+    instance*                _retired; // guarded by _mutex
+    size_t                   _num_retired;
+    mutable std::mutex       _mutex;
+    publisher (const publisher&);
+    publisher& operator= (const publisher&);
+    static void _err (const char* fn, const int ln, const char* msg)
+    { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
+    static instance* _make (trie_t* t) {
+      instance* p = new instance;
+      p->t = t; p->map[0] = p->map[1] = 0; p->map_size[0] = p->map_size[1] = 0; p->epoch = 0; p->next = 0;
+      return p;
+    }
+    static void _dispose (instance* p) {
+      if (! p) return;
+      delete p->t; // before unmapping its array
+      for (int i = 0; i < 2; ++i)
+        if (p->map[i]) ::munmap (p->map[i], p->map_size[i]);
+      delete p;
+    }
+    static int _map (const char* fn, void*& p, size_t& size) {
+      const int fd = ::open (fn, O_RDONLY);
+      if (fd < 0) return -1;
+      struct stat st;
+      if (::fstat (fd, &st) != 0 || st.st_size <= 0) { ::close (fd); return -1; }
+      size = static_cast <size_t> (st.st_size);
+      p = ::mmap (0, size, PROT_READ, MAP_SHARED, fd, 0); // set_array () takes a non-const pointer but never writes
+      ::close (fd);
+      if (p == MAP_FAILED) { p = 0; return -1; }
+      return 0;
+    }
+    size_t _publish (instance* p) {
+      std::lock_guard <std::mutex> lock (_mutex);
+      instance* old = _current.exchange (p, std::memory_order_seq_cst);
+      const uint64_t e = _epoch.fetch_add (1, std::memory_order_seq_cst) + 1; // readers from now on see p
+      if (old) {
+        old->epoch = e;
+        old->next  = _retired;
+        _retired   = old;
+        ++_num_retired;
+      }
+      return _reclaim ();
+    }
+    size_t _reclaim () {
+      uint64_t oldest = ~static_cast <uint64_t> (0);
+      for (size_t i = 0; i < _num_slots; ++i) {
+        const uint64_t e = _slot[i].epoch.load (std::memory_order_seq_cst);
+        if (e && e < oldest) oldest = e;
+      }
+      for (instance** p = &_retired; *p; ) // readers that entered before the retirement may see it
+        if ((*p)->epoch <= oldest) {
+          instance* next = (*p)->next;
+          _dispose (*p);
+          *p = next;
+          --_num_retired;
+        } else
+          p = &(*p)->next;
+      return _num_retired;
+    }
+  };
+}
+#endif
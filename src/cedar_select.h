@@ -0,0 +1,107 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//
+//  Picks a trie variant (cedar::trie, cedar::reduced_trie or cedar::prefix_trie) for a set of keys
+//  by building each on a sample of the keys and weighing its size against its lookup time.
+//  #include this file instead of <cedar.h> and <cedarpp.h>, which it includes in the order that
+//  lets the variants live together (cedar::da is then the trie of cedar.h).
+//
+//    cedar::variant_stats stats[cedar::NUM_VARIANTS];
+//    switch (cedar::selector <int>::select (keys, lens, num, vals, 0.5, 1 << 16, stats)) {
+//      case cedar::TRIE:         build (cedar::trie <int> ());         break;
+//      case cedar::REDUCED_TRIE: build (cedar::reduced_trie <int> ()); break;
+//      case cedar::PREFIX_TRIE:  build (cedar::prefix_trie <int> ());  break;
+//    }
+//
+#ifndef CEDAR_SELECT_H
+#define CEDAR_SELECT_H
+
+#include <cstddef>
+#include <limits>
+#include <chrono>
+#include <cedar.h>
+#include <cedarpp.h>
+
+namespace cedar {
+  enum variant { TRIE, REDUCED_TRIE, PREFIX_TRIE, NUM_VARIANTS };
+  struct variant_stats {
+    bool   built;   // false if the variant cannot store the values (e.g., negative ones in the reduced trie)
+    size_t size;    // bytes of the array (and tail) built on the sample
+    double lookup;  // nanoseconds per lookup of a sampled key
+  };
+  template <typename value_type_>
+  class selector {
+  public:
+    typedef value_type_ value_type;
+    // weight in [0, 1] trades size (1: the smallest) for speed (0: the fastest); sample keys are taken at a
+    // regular interval, and val may be 0 to give the i-th key the value i. stats, if given, has NUM_VARIANTS items
+    static variant select (const char** key, const size_t* len, const size_t num, const value_type* val = 0,
+                           const double weight = 0.5, const size_t sample = 1 << 16, variant_stats* stats = 0) {
+      variant_stats s[NUM_VARIANTS];
+      if (! stats) stats = s;
+      const size_t step = num > sample ? num / sample : 1;
+      _measure (trie <value_type> (),         key, len, num, val, step, stats[TRIE]);
+      _measure (reduced_trie <value_type> (), key, len, num, val, step, stats[REDUCED_TRIE]);
+      _measure (prefix_trie <value_type> (),  key, len, num, val, step, stats[PREFIX_TRIE]);
+      size_t min_size   = 0;
+      double min_lookup = 0;
+      for (size_t v = 0; v < NUM_VARIANTS; ++v)
+        if (stats[v].built) {
+          if (! min_size   || stats[v].size   < min_size)   min_size   = stats[v].size;
+          if (! min_lookup || stats[v].lookup < min_lookup) min_lookup = stats[v].lookup;
+        }
+      variant best  = TRIE;
+      double  score = 0;
+      for (size_t v = 0; v < NUM_VARIANTS; ++v) {
+        if (! stats[v].built) continue;
+        const double score_ = weight * static_cast <double> (stats[v].size) / static_cast <double> (min_size ? min_size : 1)
+          + (1 - weight) * stats[v].lookup / (min_lookup > 0 ? min_lookup : 1);
+        if (! score || score_ < score) best = static_cast <variant> (v), score = score_;
+      }
+      return best;
+    }
+  private:
+    template <typename T>
+    static size_t _size (const T& t) { return t.total_size (); }
+    static size_t _size (const prefix_trie <value_type>& t) { return t.total_size () + t.length (); }
+    template <typename T>
+    static bool _storable (const T&, const value_type) { return true; }
+    static bool _storable (const reduced_trie <value_type>&, const value_type v) { // leaves hold values
+      return std::numeric_limits <value_type>::is_integer && v >= 0 && v < reduced_trie <value_type>::CEDAR_VALUE_LIMIT;
+    }
+    template <typename T>
+    static void _measure (T t, const char** key, const size_t* len, const size_t num, const value_type* val,
+                          const size_t step, variant_stats& stats) {
+      stats.built  = false;
+      stats.size   = 0;
+      stats.lookup = 0;
+      size_t n = 0;
+      for (size_t i = 0; i < num; i += step) {
+        const value_type v = val ? val[i] : static_cast <value_type> (i);
+        if (! _storable (t, v)) return;
+        if (len[i]) t.update (key[i], len[i]) = v, ++n;
+      }
+      stats.built = true;
+      stats.size  = _size (t);
+      if (! n) return;
+      // look up the sample in a scattered order, best of three rounds
+      const size_t m = (num + step - 1) / step;
+      size_t stride = m / 2 + 1;
+      while (_gcd (stride, m) != 1) ++stride;
+      value_type sum = 0;
+      for (int round = 0; round < 3; ++round) {
+        const std::chrono::steady_clock::time_point st = std::chrono::steady_clock::now ();
+        for (size_t j = 0, k = 0; j < m; ++j, k = (k + stride) % m)
+          sum += t.template exactMatchSearch <value_type> (key[k * step], len[k * step]);
+        const double ns = std::chrono::duration <double, std::nano> (std::chrono::steady_clock::now () - st).count ()
+          / static_cast <double> (m);
+        if (! round || ns < stats.lookup) stats.lookup = ns;
+      }
+      _sink = sum; // keep the lookups
+    }
+    static size_t _gcd (size_t a, size_t b) { while (b) { const size_t r = a % b; a = b; b = r; } return a; }
+    static volatile value_type _sink;
+  };
+  template <typename value_type_>
+  volatile value_type_ selector <value_type_>::_sink = 0;
+}
+#endif
@@ -5,24 +5,32 @@
 //  a minimal-prefix trie (compact size for long keys).
 //  A reduced trie is enabled if you put #define USE_REDUCED_TRIE 1 before #include <cedar.h>,
 //  while a minimal-prefix trie is enabled if you #include <cedarpp.h> instead of cedar.h.
+//  The minimal-prefix trie is cedar::mp::da (or cedar::prefix_trie), and also cedar::da unless cedar.h has been
+//  included before, so that the variants can be used together.
 //  
 // Copyright (c) 2009-2014 Naoki Yoshinaga <ynaga@tkl.iis.u-tokyo.ac.jp>
 // 
-#ifndef CEDAR_H
-#define CEDAR_H
+#ifndef CEDARPP_H
+#define CEDARPP_H
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring> //std::strlen
 #include <climits>
 #include <cassert> //assert
+#include <cstddef> //std::ptrdiff_t
+#include <stdint.h> //uint64_t
+#include <iterator> //std::input_iterator_tag
+#include <utility> //std::swap
+#include <algorithm> //std::sort
+#if defined (__AVX2__) && ! defined (USE_RING_FIND_PLACE)
+#include <immintrin.h> //_find_place () w/ AVX2
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#define STATIC_ASSERT(e, msg) typedef char msg[(e) ? 1 : -1]
-
 namespace cedar {
   // typedefs
 #if LONG_BIT == 64
@@ -31,23 +39,42 @@ namespace cedar {
   typedef unsigned long long  npos_t;
 #endif
   typedef unsigned char  uchar;
-  static const npos_t TAIL_OFFSET_MASK = static_cast <npos_t> (0xffffffff);
-  static const npos_t NODE_INDEX_MASK  = static_cast <npos_t> (0xffffffff) << 32;
+  namespace mp { // the minimal-prefix trie and its constants; see cedar::da below
+  // a position on tail is the node with the tail in the lower bits and 1 + # bytes read on its tail in the upper
+  // bits; being relative to the record, it does not limit the size of the tail. With USE_LONG_INDEX, node ids,
+  // bases and tail offsets are long as in cedar.h, at the cost of 16-byte nodes; a suffix is then < 2^24 - 1 bytes
+#ifdef USE_LONG_INDEX
+  static const int  TAIL_OFFSET_SHIFT = 40;
+  static const long MAX_ALLOC_SIZE = 1L << 32; // must be divisible by 256
+#else
+  static const int  TAIL_OFFSET_SHIFT = 32;
+  static const int  MAX_ALLOC_SIZE = 1 << 16; // must be divisible by 256
+#endif
+  static const npos_t TAIL_OFFSET_MASK = (static_cast <npos_t> (1) << TAIL_OFFSET_SHIFT) - 1;
+  static const npos_t NODE_INDEX_MASK  = ~TAIL_OFFSET_MASK;
   template <typename T> struct NaN { enum { N1 = -1, N2 = -2 }; };
   template <> struct NaN <float> { enum { N1 = 0x7f800001, N2 = 0x7f800002 }; };
-  static const int MAX_ALLOC_SIZE = 1 << 16; // must be divisible by 256
 
   // dynamic double array
-  template <typename value_type,
-            const int     NO_VALUE  = NaN <value_type>::N1,
-            const int     NO_PATH   = NaN <value_type>::N2,
+  template <typename value_type_,
+            const int     NO_VALUE  = NaN <value_type_>::N1,
+            const int     NO_PATH   = NaN <value_type_>::N2,
             const bool    ORDERED   = true,
-            const int     MAX_TRIAL = 1,
-            const size_t  NUM_TRACKING_NODES = 0>
+            const int     MAX_TRIAL = 1>
   class da {
   public:
+    typedef value_type_ value_type;
+#ifdef USE_LONG_INDEX
+    typedef long index_type; // node ids, bases and offsets on tail
+#else
+    typedef int  index_type;
+#endif
     enum error_code { CEDAR_NO_VALUE = NO_VALUE, CEDAR_NO_PATH = NO_PATH };
     typedef value_type result_type;
+    struct payload_type { // view of a record in the payload store
+      const char* data; // 0 if not found
+      size_t      size;
+    };
     struct result_pair_type {
       value_type  value;
       size_t      length;  // prefix length
@@ -57,63 +84,175 @@ namespace cedar {
       size_t      length;  // suffix length
       npos_t      id;      // node id of value
     };
-    struct node {
-      union { int base; value_type value; }; // negative means prev empty index
-      int  check;                            // negative means next empty index
-      node (const int base_ = 0, const int check_ = 0)
-        : base (base_), check (check_) {}
-    };
     struct ninfo {  // x1.5 update speed; +.25 % memory (8n -> 10n)
       uchar  sibling;   // right sibling (= 0 if not exist)
       uchar  child;     // first child
       ninfo () : sibling (0), child (0) {}
     };
+    struct node {
+      union { index_type base; value_type value; }; // negative means prev empty index
+      index_type check;                             // negative means next empty index
+#ifdef USE_COLOCATED_NINFO
+      ninfo info;                            // padded to 12 bytes (8n + 2n -> 12n); see _info ()
+#endif
+      node (const index_type base_ = 0, const index_type check_ = 0)
+        : base (base_), check (check_) {}
+    };
     struct block { // a block w/ 256 elements
-      int   prev;   // prev block; 3 bytes
-      int   next;   // next block; 3 bytes
-      short num;    // # empty elements; 0 - 256
-      short reject; // minimum # branching failed to locate; soft limit
-      int   trial;  // # trial
-      int   ehead;  // first empty item
+      index_type prev;   // prev block; 3 bytes
+      index_type next;   // next block; 3 bytes
+      short      num;    // # empty elements; 0 - 256
+      short      reject; // minimum # branching failed to locate; soft limit
+      int        trial;  // # trial
+      index_type ehead;  // first empty item
+#ifndef USE_RING_FIND_PLACE
+      uint64_t empty[4]; // bitmap of elements in the empty ring; see _find_empty ()
+      block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0)
+      { empty[0] = empty[1] = empty[2] = empty[3] = ~static_cast <uint64_t> (0); }
+#else
       block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0) {}
+#endif
+    };
+    struct rank_block { // leaves in a block w/ 256 elements; see freeze ()
+      index_type count;  // # leaves in the preceding blocks
+      uint64_t leaf[4];  // bitmap of leaves
+      rank_block () : count (0), leaf () {}
+    };
+    struct tail_frag { // a free fragment on tail; see _push_tail ()
+      index_type offset;
+      index_type size;
+      index_type next;  // next fragment in the same size class; 0 if last
+    };
+    struct handle_rec { // a cursor; linked with the others on the same node
+      npos_t node;
+      int    prev;  // -1 if first; -2 if unused
+      int    next;  // -1 if last; next unused one if unused
+    };
+    struct handle_slot { // a node with handles
+      index_type node;
+      int        head;  // first handle; -1 if empty
+      handle_slot () : node (0), head (-1) {}
     };
     
-	da () : tracking_node (), _array (0), _tail (0), _tail0 (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _quota (0), _quota0 (0), _no_delete (false), _reject () {
-      STATIC_ASSERT(sizeof (value_type) <= sizeof (int),
-                    value_type_is_not_supported___maintain_a_value_array_by_yourself_and_store_its_index
-                    );
+	da () : _array (0), _tail (0), _tail0 (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _rank (0), _capacity (0), _size (0), _quota (0), _quota0 (0), _size0 (0), _num_keys (0), _nonzero_size (0), _nonzero_length (0), _free_length (0), _tail_mask (), _tail_shared (false), _no_delete (false), _payload (0), _payload_size (0), _payload_quota (0), _payload_no_delete (false), _reject (), _remapped (false), _handle (0), _handle_size (0), _handle_quota (0), _handle_free (-1), _num_handles (0), _hslot (0), _hslot_size (0), _hslot_used (0) {
+      static_assert (sizeof (value_type) <= sizeof (int), "value type is not supported maintain a value array by yourself and store its index");
       _initialize ();
+      _set_label_map (0);
+    }
+    ~da () { clear (false); std::free (_handle); std::free (_hslot); }
+    // move, swap and clone; a moved-from trie is left empty as if default-constructed. clone () duplicates
+    // the arrays and tail by bulk memcpy into a compact trie that owns its memory, keeping handles and the frozen state
+    da (da&& t) noexcept : da () { swap (t); } // the default constructor exits, not throws, on failure
+    da& operator= (da&& t) noexcept { da (std::move (t)).swap (*this); return *this; } // frees the old contents
+    void swap (da& t) noexcept {
+      std::swap (_array, t._array);       std::swap (_tail, t._tail);       std::swap (_tail0, t._tail0);
+      std::swap (_ninfo, t._ninfo);       std::swap (_block, t._block);
+      std::swap (_bheadF, t._bheadF);     std::swap (_bheadC, t._bheadC);   std::swap (_bheadO, t._bheadO);
+      std::swap (_rank, t._rank);         std::swap (_capacity, t._capacity); std::swap (_size, t._size);
+      std::swap (_quota, t._quota);       std::swap (_quota0, t._quota0);   std::swap (_size0, t._size0);
+      std::swap (_free_length, t._free_length); std::swap (_tail_mask[0], t._tail_mask[0]); std::swap (_tail_mask[1], t._tail_mask[1]);
+      std::swap (_num_keys, t._num_keys); std::swap (_nonzero_size, t._nonzero_size);
+      std::swap (_nonzero_length, t._nonzero_length); std::swap (_no_delete, t._no_delete);
+      std::swap (_tail_shared, t._tail_shared);
+      std::swap (_payload, t._payload);   std::swap (_payload_size, t._payload_size);
+      std::swap (_payload_quota, t._payload_quota); std::swap (_payload_no_delete, t._payload_no_delete);
+      std::swap (_reject, t._reject);     std::swap (_code, t._code);       std::swap (_decode, t._decode);
+      std::swap (_remapped, t._remapped);
+      std::swap (_handle, t._handle);     std::swap (_handle_size, t._handle_size);
+      std::swap (_handle_quota, t._handle_quota); std::swap (_handle_free, t._handle_free);
+      std::swap (_num_handles, t._num_handles);
+      std::swap (_hslot, t._hslot);       std::swap (_hslot_size, t._hslot_size); std::swap (_hslot_used, t._hslot_used);
+    }
+    da clone () const {
+      da t;
+      t.clear (false);
+      const size_t size = static_cast <size_t> (_size);
+      t._array = _dup (_array, size);
+      t._ninfo = _dup (_ninfo, size);
+      t._block = _dup (_block, size >> 8);
+      t._rank  = _dup (_rank,  size >> 8);
+      t._bheadF = _bheadF; t._bheadC = _bheadC; t._bheadO = _bheadO;
+      t._capacity = t._size = _size;
+      t._tail  = _dup (_tail, static_cast <size_t> (*_length));
+      t._quota = *_length;
+      t._tail0  = _dup (_tail0, static_cast <size_t> (_size0));
+      t._size0  = t._quota0 = t._tail0 ? _size0 : 0;
+      t._free_length = t._tail0 ? _free_length : 0;
+      t._tail_mask[0] = t._tail0 ? _tail_mask[0] : 0;
+      t._tail_mask[1] = t._tail0 ? _tail_mask[1] : 0;
+      t._num_keys = _num_keys;
+      t._nonzero_size = _nonzero_size;
+      t._nonzero_length = _nonzero_length;
+      t._tail_shared = _tail_shared;
+      t._payload = _dup (_payload, _payload_size);
+      t._payload_size = t._payload_quota = t._payload ? _payload_size : 0;
+      std::memcpy (t._reject, _reject, sizeof (_reject));
+      std::memcpy (t._code,   _code,   sizeof (_code));
+      std::memcpy (t._decode, _decode, sizeof (_decode));
+      t._remapped = _remapped;
+      t._handle = _dup (_handle, static_cast <size_t> (_handle_size));
+      t._handle_size = t._handle_quota = t._handle ? _handle_size : 0;
+      t._handle_free = _handle_free;
+      t._num_handles = _num_handles;
+      t._hslot = _dup (_hslot, static_cast <size_t> (_hslot_size));
+      t._hslot_size = t._hslot ? _hslot_size : 0;
+      t._hslot_used = _hslot_used;
+      return t;
     }
-    ~da () { clear (false); }
 
     size_t capacity   () const { return static_cast <size_t> (_capacity); }
     size_t size       () const { return static_cast <size_t> (_size); }
     size_t length     () const { return static_cast <size_t> (*_length); }
     size_t total_size () const { return sizeof (node) * _size; }
     size_t unit_size  () const { return sizeof (node); }
-    size_t nonzero_size () const {
+    // O(1) counters maintained by update () and erase ()
+    size_t nonzero_size   () const { return static_cast <size_t> (_nonzero_size); }
+    size_t nonzero_length () const { return static_cast <size_t> (_nonzero_length); }
+    size_t free_length    () const { return static_cast <size_t> (_free_length); } // bytes update () can reuse
+    size_t num_keys       () const { return static_cast <size_t> (_num_keys); }
+    // same as the above but computed by scanning the whole array; for cross-checking
+    size_t nonzero_size_by_scan () const {
       size_t i = 0;
-      for (int to = 0; to < _size; ++to)
+      for (index_type to = 0; to < _size; ++to)
         if (_array[to].check >= 0) ++i;
       return i;
     }
-    size_t nonzero_length () const {
-      size_t i (0), j (0);
-      for (int to = 0; to < _size; ++to) {
-        const node& n = _array[to];
-        if (n.check >= 0 && _array[n.check].base != to && n.base < 0)
-          { ++j; for (const char* p = &_tail[-n.base]; *p; ++p) ++i; }
+    size_t nonzero_length_by_scan () const {
+      if (_tail_shared) { // bytes covered by any record
+        char* used = static_cast <char*> (std::calloc (static_cast <size_t> (*_length), 1));
+        if (! used) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        for (index_type to = 0; to < _size; ++to) {
+          const node& n = _array[to];
+          if (_on_tail (to)) {
+            const size_t len = _tail_len (&_tail[-n.base]);
+            std::memset (&used[static_cast <size_t> (-n.base) - _tail_head (len)], 1, _tail_size (len));
+          }
+        }
+        size_t i = 0;
+        for (index_type k = 0; k < *_length; ++k) i += static_cast <size_t> (used[k]);
+        std::free (used);
+        return i;
       }
-      return i + j * (1 + sizeof (value_type));
-    }
-    size_t num_keys () const {
       size_t i = 0;
-      for (int to = 0; to < _size; ++to) {
+      for (index_type to = 0; to < _size; ++to) {
         const node& n = _array[to];
-        if (n.check >= 0 && (_array[n.check].base == to || n.base < 0)) ++i;
+        if (_on_tail (to))
+          i += _tail_size (_tail_len (&_tail[-n.base]));
       }
       return i;
     }
+    size_t free_length_by_scan () const {
+      size_t i = 0;
+      for (index_type c = 0; _size0 && c < TAIL_CLASSES; ++c)
+        for (index_type e = c ? _tail0[c].next : 0; e; e = _tail0[e].next) i += static_cast <size_t> (_tail0[e].size);
+      return i;
+    }
+    size_t num_keys_by_scan () const {
+      size_t i = 0;
+      for (index_type to = 0; to < _size; ++to)
+        if (_is_leaf (to)) ++i;
+      return i;
+    }
     // interfance
     template <typename T>
     T exactMatchSearch (const char* key) const
@@ -129,6 +268,67 @@ namespace cedar {
       _set_result (&result, b.x, len, from);
       return result;
     }
+    // lookup for sorted query streams; resumes at the node of the longest common prefix with the previous query,
+    // which may be a position on tail (from >> TAIL_OFFSET_SHIFT). Call reset () if the trie has been updated since
+    // the last query
+    class sorted_searcher {
+    public:
+      explicit sorted_searcher (const da& t) : _t (&t), _key (0), _path (0), _len (0), _capacity (0) {}
+      ~sorted_searcher () { std::free (_key); std::free (_path); }
+      void reset () { _len = 0; }
+      template <typename T>
+      T exactMatchSearch (const char* key) { return exactMatchSearch <T> (key, std::strlen (key)); }
+      template <typename T>
+      T exactMatchSearch (const char* key, size_t len) {
+        const da& t = *_t;
+        if (_capacity <= len) {
+          _capacity = len + 1;
+          _realloc_array (_key,  static_cast <index_type> (_capacity));
+          _realloc_array (_path, static_cast <index_type> (_capacity));
+        }
+        size_t pos = 0;
+        while (pos < _len && pos < len && _key[pos] == key[pos]) ++pos;
+        _path[0] = 0;
+        npos_t from = _path[pos];
+        for (const uchar* const key_ = reinterpret_cast <const uchar*> (key); pos < len; _path[++pos] = from) {
+          const npos_t     k    = from >> TAIL_OFFSET_SHIFT;
+          const index_type base = t._array[from & TAIL_OFFSET_MASK].base;
+          if (k || base < 0) { // on tail
+            const size_t offset_ = k ? t._tail_offset (from) : static_cast <size_t> (-base);
+            if (t._is_tail_end (from & TAIL_OFFSET_MASK, offset_) || t._tail[offset_] != key[pos]) break;
+            from = t._tail_npos (from & TAIL_OFFSET_MASK, offset_ + 1);
+          } else {
+            const size_t to = static_cast <size_t> (base) ^ t._code[key_[pos]];
+            if (t._array[to].check != static_cast <index_type> (from)) break;
+            from = to;
+          }
+          _key[pos] = key[pos];
+        }
+        _len = pos; // _path[0.._len] are valid
+        union { int i; value_type x; } b;
+        b.i = t._find (key, from, pos, len);
+        if (b.i == CEDAR_NO_PATH) b.i = CEDAR_NO_VALUE;
+        T result;
+        t._set_result (&result, b.x, len, from);
+        return result;
+      }
+    private:
+      // currently disabled; implement these if you need
+      sorted_searcher (const sorted_searcher&);
+      sorted_searcher& operator= (const sorted_searcher&);
+      const da* _t;
+      char*     _key;      // previous query
+      npos_t*   _path;     // _path[i]: node (or position on tail) after reading i bytes of the previous query
+      size_t    _len;
+      size_t    _capacity;
+    };
+    // looks up num keys with sorted_searcher and stores the result for key[i] in result[i]; faster for sorted keys
+    template <typename T>
+    void exactMatchSearchBatch (size_t num, const char** key, T* result, const size_t* len = 0) const {
+      sorted_searcher s (*this);
+      for (size_t i = 0; i < num; ++i)
+        result[i] = s.template exactMatchSearch <T> (key[i], len ? len[i] : std::strlen (key[i]));
+    }
 
     template <typename T, typename TSentinel>
     size_t commonPrefixSearch (const char* key, T* result, size_t result_len, TSentinel sentinel) const
@@ -163,13 +363,32 @@ namespace cedar {
       }
       return num;
     }
+    // visitor version of commonPrefixSearch (); visitor (value, length, id) is called for
+    // each prefix with a value until it returns false; returns the number of visited items
+    template <typename V>
+    size_t commonPrefixVisit (const char* key, V visitor) const
+    { return commonPrefixVisit (key, std::strlen (key), visitor); }
+
+    template <typename V>
+    size_t commonPrefixVisit (const char* key, size_t len, V visitor, npos_t from = 0) const {
+      size_t num = 0;
+      for (size_t pos = 0; pos < len; ) {
+        union { int i; value_type x; } b;
+        b.i = _find (key, from, pos, pos + 1);
+        if (b.i == CEDAR_NO_VALUE) continue;
+        if (b.i == CEDAR_NO_PATH)  break;
+        ++num;
+        if (! visitor (b.x, pos, from)) break;
+      }
+      return num;
+    }
     // predict key from double array
     template <typename T>
-    size_t commonPrefixPredict (const char* key, T* result, size_t result_len)
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len) const
     { return commonPrefixPredict (key, result, result_len, std::strlen (key)); }
 
     template <typename T>
-    size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len, npos_t from = 0) {
+    size_t commonPrefixPredict (const char* key, T* result, size_t result_len, size_t len, npos_t from = 0) const {
       size_t num (0), pos (0), p (0);
       if (_find (key, from, pos, len) == CEDAR_NO_PATH) return 0;
       union { int i; value_type x; } b;
@@ -180,19 +399,112 @@ namespace cedar {
       }
       return num;
     }
+    // visitor version of commonPrefixPredict ()
+    template <typename V>
+    size_t commonPrefixPredictVisit (const char* key, V visitor) const
+    { return commonPrefixPredictVisit (key, std::strlen (key), visitor); }
+
+    template <typename V>
+    size_t commonPrefixPredictVisit (const char* key, size_t len, V visitor, npos_t from = 0) const {
+      size_t num (0), pos (0), p (0);
+      if (_find (key, from, pos, len) == CEDAR_NO_PATH) return 0;
+      union { int i; value_type x; } b;
+      const npos_t root = from;
+      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p, root)) {
+        ++num;
+        if (! visitor (b.x, p, from)) break;
+      }
+      return num;
+    }
+    // input iterators over the results of commonPrefixSearch () and commonPrefixPredict ();
+    // a default-constructed iterator is the end
+    class prefix_iterator {
+    public:
+      typedef std::input_iterator_tag   iterator_category;
+      typedef result_triple_type        value_type;
+      typedef std::ptrdiff_t            difference_type;
+      typedef const result_triple_type* pointer;
+      typedef const result_triple_type& reference;
+      prefix_iterator () : _t (0), _key (0), _len (0), _pos (0), _r () {}
+      prefix_iterator (const da* t, const char* key, size_t len, npos_t from = 0)
+        : _t (t), _key (key), _len (len), _pos (0), _r () { _r.id = from; ++*this; }
+      reference operator*  () const { return _r; }
+      pointer   operator-> () const { return &_r; }
+      prefix_iterator& operator++ () {
+        while (_pos < _len) {
+          union { int i; typename da::value_type x; } b;
+          b.i = _t->_find (_key, _r.id, _pos, _pos + 1);
+          if (b.i == CEDAR_NO_VALUE) continue;
+          if (b.i == CEDAR_NO_PATH)  break;
+          _t->_set_result (&_r, b.x, _pos, _r.id);
+          return *this;
+        }
+        _t = 0, _pos = 0; // end
+        return *this;
+      }
+      prefix_iterator operator++ (int) { prefix_iterator it (*this); ++*this; return it; }
+      bool operator== (const prefix_iterator& it) const { return _t == it._t && _pos == it._pos; }
+      bool operator!= (const prefix_iterator& it) const { return ! (*this == it); }
+    private:
+      const da*          _t;
+      const char*        _key;
+      size_t             _len;
+      size_t             _pos;
+      result_triple_type _r;
+    };
+
+    class predict_iterator {
+    public:
+      typedef std::input_iterator_tag   iterator_category;
+      typedef result_triple_type        value_type;
+      typedef std::ptrdiff_t            difference_type;
+      typedef const result_triple_type* pointer;
+      typedef const result_triple_type& reference;
+      predict_iterator () : _t (0), _root (0), _r () {}
+      predict_iterator (const da* t, const char* key, size_t len, npos_t from = 0) : _t (t), _root (0), _r () {
+        size_t pos = 0;
+        if (_t->_find (key, from, pos, len) == CEDAR_NO_PATH) { _t = 0; return; }
+        _root = _r.id = from;
+        _set (_t->begin (_r.id, _r.length));
+      }
+      reference operator*  () const { return _r; }
+      pointer   operator-> () const { return &_r; }
+      predict_iterator& operator++ () { _set (_t->next (_r.id, _r.length, _root)); return *this; }
+      predict_iterator operator++ (int) { predict_iterator it (*this); ++*this; return it; }
+      bool operator== (const predict_iterator& it) const { return _t == it._t && _r.id == it._r.id; }
+      bool operator!= (const predict_iterator& it) const { return ! (*this == it); }
+    private:
+      const da*          _t;
+      npos_t             _root;
+      result_triple_type _r;
+      void _set (const int i) {
+        union { int i; typename da::value_type x; } b;
+        b.i = i;
+        if (b.i == CEDAR_NO_PATH) _t = 0, _r.id = 0; // end
+        else _r.value = b.x;
+      }
+    };
+
+    prefix_iterator  prefix_begin  (const char* key, size_t len, npos_t from = 0) const
+    { return prefix_iterator (this, key, len, from); }
+    prefix_iterator  prefix_end    () const { return prefix_iterator (); }
+    predict_iterator predict_begin (const char* key, size_t len, npos_t from = 0) const
+    { return predict_iterator (this, key, len, from); }
+    predict_iterator predict_end   () const { return predict_iterator (); }
 
     void suffix(char *key, size_t len, npos_t to) const {
       key[len] = '\0';
-      if (const int offset = static_cast <int> (to >> 32)) {
+      if (to >> TAIL_OFFSET_SHIFT) {
+        const size_t offset = _tail_offset (to);
+        size_t len_tail = static_cast <size_t> (to >> TAIL_OFFSET_SHIFT) - 1; // read on tail
         to &= TAIL_OFFSET_MASK;
-        size_t len_tail = std::strlen (&_tail[-_array[to].base]);
         if (len > len_tail) len -= len_tail; else len_tail = len, len = 0;
-        std::memcpy (&key[len], &_tail[static_cast <size_t> (offset) - len_tail], len_tail);
+        std::memcpy (&key[len], &_tail[offset - len_tail], len_tail);
       }
       while (len--) {
-        const int from = _array[to].check;
+        const index_type from = _array[to].check;
         key[len]
-          = static_cast <char> (_array[from].base ^ static_cast <int> (to));
+          = static_cast <char> (_decode[_array[from].base ^ static_cast <index_type> (to)]);
         to = static_cast <npos_t> (from);
       }
     }
@@ -205,113 +517,306 @@ namespace cedar {
       return b.x;
     }
 
-    struct empty_callback { void operator () (const int, const int) {} }; // dummy empty function
+    struct empty_callback { void operator () (const index_type, const index_type) {} }; // dummy empty function
     value_type& update (const char* key)
     { return update (key, std::strlen (key)); }
     value_type& update (const char* key, size_t len, value_type val = value_type (0))
     { npos_t from (0); size_t pos (0); return update (key, from, pos, len, val); }
     value_type& update (const char* key, npos_t& from, size_t& pos, size_t len, value_type val = value_type (0))
     { empty_callback cf; return update (key, from, pos, len, val, cf); }
+    // versions with inserted tell whether key has been newly inserted in a single traversal
+    value_type& update (const char* key, size_t len, value_type val, bool& inserted)
+    { npos_t from (0); size_t pos (0); empty_callback cf; return update (key, from, pos, len, val, cf, inserted); }
+
+    template <typename T>
+    value_type& update (const char* key, npos_t& from, size_t& pos, size_t len, value_type val, T& cf)
+    { bool inserted = false; return update (key, from, pos, len, val, cf, inserted); }
 
     template <typename T>
-    value_type& update (const char* key, npos_t& from, size_t& pos, size_t len, value_type val, T& cf) {
+    value_type& update (const char* key, npos_t& from, size_t& pos, size_t len, value_type val, T& cf, bool& inserted) {
       if (! len && ! from)
         _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
+      if (_rank) thaw ();
 #ifndef USE_FAST_LOAD
-      if (! _ninfo || ! _block) restore ();
+      if (! _has_ninfo () || ! _block) restore ();
 #endif
-      npos_t offset = from >> 32;
+      if (_tail_shared || _tail_dead ()) shrink_tail ();
+      npos_t offset = from >> TAIL_OFFSET_SHIFT ? _tail_offset (from) : 0;
       if (! offset) { // node on trie
         for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
              _array[from].base >= 0; ++pos) {
-          if (pos == len)
-            { const int to = _follow (from, 0, cf); return _array[to].value += val; }
-          from = static_cast <size_t> (_follow (from, key_[pos], cf));
+          if (pos == len) {
+            const index_type to = _follow_terminal (from, cf, inserted);
+            return _array[to].value += val;
+          }
+          from = static_cast <size_t> (_follow (from, _code[key_[pos]], cf));
         }
         offset = static_cast <npos_t> (-_array[from].base);
       }
-      if (offset >= sizeof (int)) { // go to _tail
+      if (offset >= sizeof (index_type)) { // go to _tail
         const size_t pos_orig = pos;
+        const npos_t head = static_cast <npos_t> (-_array[from & TAIL_OFFSET_MASK].base); // record to split
+        const size_t len_tail = _tail_len (&_tail[head]);
+        const size_t end = pos + (head + len_tail - offset); // key position at the tail end
         char* const tail = &_tail[offset] - pos;
-        while (pos < len && key[pos] == tail[pos]) ++pos;
+        pos += _match (key + pos, tail + pos, (len < end ? len : end) - pos);
         //
-        if (pos == len && tail[pos] == '\0') { // found exact key
-          if (const npos_t moved = pos - pos_orig) { // search end on tail
-            from &= TAIL_OFFSET_MASK;
-            from |= (offset + moved) << 32;
-          }
-          return *reinterpret_cast <value_type*> (&tail[len + 1]) += val;
+        if (pos == len && pos == end) { // found exact key
+          inserted = false;
+          if (const npos_t moved = pos - pos_orig) // search end on tail
+            from = _tail_npos (from & TAIL_OFFSET_MASK, offset + moved);
+          return _tail_value (tail, len) += val;
         }
         // otherwise, insert the common prefix in tail if any
-        if (from >> 32) {
+        // handles on this tail are put aside and settle on the new nodes that take over their positions
+        int pending = _num_handles ? _detach_tail_handles (from & TAIL_OFFSET_MASK) : -1;
+        // (handles hold 1 + # bytes read on the record from head)
+        if (from >> TAIL_OFFSET_SHIFT) {
           from &= TAIL_OFFSET_MASK; // reset to update tail offset
-          for (npos_t offset_ = static_cast <npos_t> (-_array[from].base);
-               offset_ < offset; ) {
+          for (npos_t offset_ = head; offset_ < offset; ) {
             from = static_cast <size_t>
-                   (_follow (from, static_cast <uchar> (_tail[offset_]), cf));
+                   (_follow (from, _code[static_cast <uchar> (_tail[offset_])], cf));
             ++offset_;
             // this shows intricacy in debugging updatable double array trie
-            if (NUM_TRACKING_NODES) // keep the traversed node (on tail) updated
-              for (size_t j = 0; tracking_node[j] != 0; ++j)
-                if (tracking_node[j] >> 32 == offset_)
-                  tracking_node[j] = static_cast <npos_t> (from);
+            if (pending >= 0) _settle_handles (pending, offset_ - head + 1, from);
           }
         }
-        for (size_t pos_ = pos_orig; pos_ < pos; ++pos_)
+        if (pending >= 0) _settle_handles (pending, offset - head + 1, from);
+        for (size_t pos_ = pos_orig; pos_ < pos; ++pos_) {
           from = static_cast <size_t>
-                 (_follow (from, static_cast <uchar> (key[pos_]), cf));
-        npos_t moved = pos - pos_orig;
-        if (tail[pos]) { // remember to move offset to existing tail
-          const int to_ = _follow (from, static_cast <uchar> (tail[pos]), cf);
-          _array[to_].base = - static_cast <int> (offset + ++moved);
-          moved -= 1 + sizeof (value_type); // keep record
-        }
-        moved += offset;
-        for (npos_t i = offset; i <= moved; i += 1 + sizeof (value_type)) {
-          if (_quota0 == ++*_length0) {
-#ifdef USE_EXACT_FIT
-            _quota0 += *_length0 >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length0;
-#else
-            _quota0 += _quota0;
-#endif
-            _realloc_array (_tail0, _quota0, *_length0);
-          }
-          _tail0[*_length0] = static_cast <int> (i);
+                 (_follow (from, _code[static_cast <uchar> (key[pos_])], cf));
+          if (pending >= 0) _settle_handles (pending, offset + pos_ + 1 - pos_orig - head + 1, from);
+        }
+        const npos_t freed = head - _tail_head (len_tail); // bytes in [freed, moved) are freed
+        npos_t moved = offset + pos - pos_orig;
+        if (pos < end) { // remember to move offset to existing tail
+          const index_type to_ = _follow (from, _code[static_cast <uchar> (tail[pos])], cf);
+          const size_t len_tail_ = end - pos - 1;
+          _array[to_].base = - static_cast <index_type> (++moved);
+          _set_tail_len (&_tail[moved], len_tail_);
+          _nonzero_length -= static_cast <index_type> (_tail_size (len_tail) - _tail_size (len_tail_));
+          if (pending >= 0) // the rest of the tail, now read from moved
+            _settle_handles (pending, 0, static_cast <npos_t> (to_), moved - head);
+          moved -= _tail_head (len_tail_); // keep record
+        } else { // existing key moves onto trie
+          _nonzero_length -= static_cast <index_type> (_tail_size (len_tail));
+          moved += TAIL_TERM + sizeof (value_type);
+          if (pending >= 0) _settle_handles (pending, 0, from);
         }
-        if (pos == len || tail[pos] == '\0') {
-          const int to = _follow (from, 0, cf);
-          if (pos == len) return _array[to].value += val; // set value on tail
-          _array[to].value += *reinterpret_cast <value_type*> (&tail[pos + 1]);
+        if (freed < moved) _push_tail (freed, moved - freed);
+        if (pos == len || pos == end) {
+          const index_type to = _follow (from, 0, cf);
+          if (pos == len) { inserted = true; ++_num_keys; return _array[to].value += val; } // set value on tail
+          _array[to].value += _tail_value (tail, pos);
         }
-        from = static_cast <size_t> (_follow (from, static_cast <uchar> (key[pos]), cf));
+        from = static_cast <size_t> (_follow (from, _code[static_cast <uchar> (key[pos])], cf));
         ++pos;
       }
-      const int needed = static_cast <int> (len - pos + 1 + sizeof (value_type));
-      if (pos == len && *_length0) { // reuse
-        const int offset0 = _tail0[*_length0];
-        _tail[offset0] = '\0';
-        _array[from].base = -offset0;
-        --*_length0;
-        return *reinterpret_cast <value_type*> (&_tail[offset0 + 1]) = val;
-      }
-      if (_quota < *_length + needed) {
+      if (len - pos >= static_cast <size_t> (NODE_INDEX_MASK >> TAIL_OFFSET_SHIFT))
+        _err (__FILE__, __LINE__, "suffix is too long to keep a position on tail\n");
+      inserted = true;
+      ++_num_keys;
+      const index_type needed = static_cast <index_type> (_tail_size (len - pos));
+      _nonzero_length += needed;
+      size_t offset_ = 0;
+      if (! _pop_tail (static_cast <size_t> (needed), offset_)) { // append
+        if (_quota < *_length + needed) {
 #ifdef USE_EXACT_FIT
-        _quota += needed > *_length || needed > MAX_ALLOC_SIZE ? needed :
-                  (*_length >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length);
+          _quota += needed > *_length || needed > MAX_ALLOC_SIZE ? needed :
+                    (*_length >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : *_length);
 #else
-        _quota += _quota >= needed ? _quota : needed;
+          _quota += _quota >= needed ? _quota : needed;
 #endif
-        _realloc_array (_tail, _quota, *_length);
+          _realloc_array (_tail, _quota, *_length);
+        }
+        offset_ = static_cast <size_t> (*_length);
+        *_length += needed;
       }
-      _array[from].base = -*_length;
-      const size_t pos_orig = pos;
-      char* const tail = &_tail[*_length] - pos;
+      offset_ += _tail_head (len - pos);
+      _array[from].base = - static_cast <index_type> (offset_);
+      _set_tail_len (&_tail[offset_], len - pos);
+      char* const tail = &_tail[offset_] - pos;
       if (pos < len) {
-        do tail[pos] = key[pos]; while (++pos < len);
-        from |= (static_cast <npos_t> (*_length) + (len - pos_orig)) << 32;
+        std::memcpy (tail + pos, key + pos, len - pos);
+        from = _tail_npos (from, offset_ + len - pos);
       }
-      *_length += needed;
-      return *reinterpret_cast <value_type*> (&tail[len + 1]) += val;
+      return _tail_value (tail, len) = val;
+    }
+    // bulk upsert for sorted key streams; resumes at the node of the longest common prefix with the previous key,
+    // whose path is kept valid over node moves by hooking the callback. The path stops at a node with tail, from
+    // which the general update () takes over. Update or erase the trie by other means only after calling reset ()
+    class sorted_updater {
+    public:
+      explicit sorted_updater (da& t) : _t (&t), _key (0), _path (0), _len (0), _capacity (0) {}
+      ~sorted_updater () { std::free (_key); std::free (_path); }
+      void reset () { _len = 0; }
+      value_type& update (const char* key, size_t len, value_type val = value_type (0))
+      { empty_callback cf; return update (key, len, val, cf); }
+      template <typename T>
+      value_type& update (const char* key, size_t len, value_type val, T& cf)
+      { bool inserted = false; return update (key, len, val, cf, inserted); }
+      template <typename T>
+      value_type& update (const char* key, size_t len, value_type val, T& cf, bool& inserted) {
+        if (! len) _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
+        da& t = *_t;
+        if (t._rank) t.thaw ();
+#ifndef USE_FAST_LOAD
+        if (! t._has_ninfo () || ! t._block) t.restore ();
+#endif
+        if (t._tail_shared) t.shrink_tail ();
+        if (_capacity <= len) {
+          _capacity = len + 1;
+          _realloc_array (_key,  static_cast <index_type> (_capacity));
+          _realloc_array (_path, static_cast <index_type> (_capacity));
+        }
+        size_t pos = 0;
+        while (pos < _len && pos < len && _key[pos] == key[pos]) ++pos;
+        _path[0] = 0;
+        path_callback <T> cf_ (*this, cf);
+        npos_t from = _path[pos];
+        for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
+             t._array[from].base >= 0; _path[++pos] = from) {
+          _len = pos; // _path[0.._len] are valid
+          if (pos == len) {
+            const index_type to = t._follow_terminal (from, cf_, inserted);
+            return t._array[to].value += val;
+          }
+          _key[pos] = key[pos];
+          from = static_cast <size_t> (t._follow (from, t._code[key_[pos]], cf_));
+        }
+        _len = pos;
+        return t.update (key, from, pos, len, val, cf_, inserted); // on tail
+      }
+    private:
+      template <typename T>
+      struct path_callback { // remap the nodes on the path if moved, then call the user callback
+        sorted_updater& u;
+        T&              cf;
+        size_t          depth; // of the parent of the last moved node on the path
+        path_callback (sorted_updater& u_, T& cf_) : u (u_), cf (cf_), depth (0) {}
+        void operator () (const index_type from, const index_type to) {
+          // nodes moved by one _resolve () share the parent (already the check of to), so the path is
+          // searched once per parent and only the next node on the path can be the one moved
+          const npos_t parent = static_cast <npos_t> (u._t->_array[to].check);
+          if (depth >= u._len || u._path[depth] != parent) {
+            depth = 0;
+            while (depth < u._len && u._path[depth] != parent) ++depth;
+          }
+          if (depth < u._len && u._path[depth + 1] == static_cast <npos_t> (from))
+            u._path[depth + 1] = static_cast <npos_t> (to);
+          cf (from, to);
+        }
+      };
+      // currently disabled; implement these if you need
+      sorted_updater (const sorted_updater&);
+      sorted_updater& operator= (const sorted_updater&);
+      da*     _t;
+      char*   _key;      // previous key
+      npos_t* _path;     // _path[i]: node after reading i bytes of the previous key
+      size_t  _len;
+      size_t  _capacity;
+    };
+    /*
+     * Merge (union) trie t into this trie by walking the two in parallel along the child lists. Nodes missing
+     * in this trie are created one by one from those of t, and a suffix on tail of t is inserted by update ()
+     * at its node; where this trie has a tail and t has a subtree, the keys of the subtree are inserted from
+     * the last common node. A key in both gets combine (value in this, value in t); see merge_sum, merge_max
+     * and merge_overwrite. The cost is linear in the nodes of t, so merge the smaller trie into the larger
+     * one. t may be a loaded trie without ninfo or have another label map. Returns the number of keys added.
+    */
+    template <typename F>
+    size_t merge (const da& t, F combine) {
+      if (&t == this) { const da c = clone (); return merge (c, combine); }
+      if (_rank) thaw ();
+#ifndef USE_FAST_LOAD
+      if (! _has_ninfo () || ! _block) restore ();
+#endif
+      if (_tail_shared) shrink_tail ();
+      const index_type num_keys = _num_keys;
+      int capacity = 16;
+      char* key = 0; // key bytes of t on the path and tail
+      int key_capacity = 256;
+      _merge_callback cf = { 0, 0 };
+      _realloc_array (cf.path, capacity);
+      _realloc_array (key, key_capacity);
+      const _merge_frame root = { 0, 0, -1, 0 };
+      cf.path[cf.n++] = root;
+      while (cf.n) {
+        _merge_frame& f = cf.path[cf.n - 1];
+        const size_t d = cf.n - 1; // depth
+        const index_type base_ = t._array[f.from_].base;
+        uchar c = 0;
+        if (f.label < 0) {
+          if (! (c = t._child (f.from_, base_)) && ! f.from_) { --cf.n; continue; } // empty trie
+        } else if (! (c = t._sibling (static_cast <npos_t> (base_ ^ f.label), f.from_))) { --cf.n; continue; }
+        f.label = c;
+        const bool attached = f.depth == d; // f.from is the node of the path; otherwise, its ancestor at f.depth
+        const index_type to_ = base_ ^ c;
+        if (! c) { // terminal
+          if (attached) _merge_terminal (f.from, t._array[to_].value, combine, cf);
+          else _merge_key (key + f.depth, d - f.depth, f.from, t._array[to_].value, combine, cf);
+          continue;
+        }
+        const char* const tail = t._array[to_].base < 0 ? &t._tail[-t._array[to_].base] : 0; // suffix on tail
+        const int len = tail ? static_cast <int> (_tail_len (tail)) : 0;
+        if (key_capacity <= static_cast <int> (d) + 1 + len) {
+          const int key_capacity_ = key_capacity;
+          while (key_capacity <= static_cast <int> (d) + 1 + len) key_capacity <<= 1;
+          _realloc_array (key, key_capacity, key_capacity_);
+        }
+        key[d] = static_cast <char> (t._decode[c]);
+        if (tail) {
+          std::memcpy (key + d + 1, tail, static_cast <size_t> (len));
+          const value_type val = _tail_value (tail, static_cast <size_t> (len));
+          if (attached) {
+            npos_t from = f.from;
+            const npos_t to = static_cast <npos_t> (_follow (from, _code[static_cast <uchar> (key[d])], cf));
+            _merge_key (key + d + 1, static_cast <size_t> (len), to, val, combine, cf);
+          } else
+            _merge_key (key + f.depth, d + 1 + static_cast <size_t> (len) - f.depth, f.from, val, combine, cf);
+          continue;
+        }
+        _merge_frame next = { f.from, static_cast <npos_t> (to_), -1, f.depth };
+        if (attached) {
+          const index_type base = _array[f.from].base;
+          const index_type to = base ^ _code[static_cast <uchar> (key[d])];
+          if (base < 0 || _array[to].check != static_cast <index_type> (f.from) || _array[to].base >= 0) { // no tail
+            next.from  = static_cast <npos_t> (_follow (f.from, _code[static_cast <uchar> (key[d])], cf));
+            next.depth = d + 1;
+          }
+        }
+        if (static_cast <int> (cf.n) == capacity) _realloc_array (cf.path, capacity << 1, capacity), capacity <<= 1;
+        cf.path[cf.n++] = next;
+      }
+      std::free (cf.path);
+      std::free (key);
+      return static_cast <size_t> (_num_keys - num_keys);
+    }
+    struct merge_sum       { value_type operator () (const value_type a, const value_type b) const { return a + b; } };
+    struct merge_max       { value_type operator () (const value_type a, const value_type b) const { return a < b ? b : a; } };
+    struct merge_overwrite { value_type operator () (const value_type,   const value_type b) const { return b; } };
+    /*
+     * Synchronized traversal of this trie (old) and t (new). visitor (key, len, old_value, new_value) is called for each
+     * key added (old_value == CEDAR_NO_VALUE), removed (new_value == CEDAR_NO_VALUE) or changed, and the traversal stops
+     * when it returns false; key is valid during the call. A subtree in only one trie is enumerated without probing the
+     * other, two suffixes on tail are compared at once, and nothing is walked for the same trie. Events of a node come
+     * with the children of t first, so keys are not sorted. Returns the number of events.
+    */
+    template <typename V>
+    size_t diffVisit (const da& t, V visitor) const { return &t == this ? 0 : _diff (t, visitor, false); }
+    // keys in both tries, with the values of this trie
+    da intersect (const da& t) const {
+      da r;
+      _set_op_visitor v = { &r, true };
+      _diff (t, v, true);
+      return r;
+    }
+    // keys of this trie not in t
+    da subtract (const da& t) const {
+      da r;
+      _set_op_visitor v = { &r, false };
+      if (&t != this) _diff (t, v, false);
+      return r;
     }
     // easy-going erase () without compression
     int erase (const char* key) { return erase (key, std::strlen (key)); }
@@ -319,25 +824,102 @@ namespace cedar {
       size_t pos = 0;
       const int i = _find (key, from, pos, len);
       if (i == CEDAR_NO_PATH || i == CEDAR_NO_VALUE) return -1;
-      if (from >> 32) from &= TAIL_OFFSET_MASK; // leave tail as is
+      if (_rank) thaw ();
+      if (_tail_shared) shrink_tail ();
+      from &= TAIL_OFFSET_MASK; // leave tail as is
       bool flag = _array[from].base < 0; // have sibling
-      int e = flag ? static_cast <int> (from) : _array[from].base ^ 0;
+      if (flag) { // free record on tail
+        const size_t len_tail = _tail_len (&_tail[-_array[from].base]);
+        _nonzero_length -= static_cast <index_type> (_tail_size (len_tail));
+        _push_tail (static_cast <size_t> (-_array[from].base) - _tail_head (len_tail), _tail_size (len_tail));
+      }
+      --_num_keys;
+      index_type e = flag ? static_cast <index_type> (from) : _array[from].base ^ 0;
       from  = _array[e].check;
       do {
         const node& n = _array[from];
-        flag = _ninfo[n.base ^ _ninfo[from].child].sibling;
+        flag = _info (n.base ^ _info (from).child).sibling;
         if (flag) _pop_sibling (from, n.base, static_cast <uchar> (n.base ^ e));
         _push_enode (e);
-         e = static_cast <int> (from);
+         e = static_cast <index_type> (from);
         from = static_cast <size_t> (_array[from].check);
       } while (! flag);
       return 0;
     }
+    // Integer sequence keys (e.g., word-id n-grams); see cedar.h for the encoding. Lookups walk the trie
+    // (and tail) one id at a time; update () and erase () encode the key since it may go to tail
+    enum { MAX_ID_BYTES = 6 };
+    static size_t encode_id (const uint32_t id, char* key) {
+      size_t n = 1;
+      while (n < MAX_ID_BYTES && id >> (6 * n + 1)) ++n;
+      key[0] = static_cast <char> (_id_head (n) + (static_cast <uint64_t> (id) >> (7 * (n - 1))));
+      for (size_t i = 1; i < n; ++i)
+        key[i] = static_cast <char> (0x80 | ((id >> (7 * (n - 1 - i))) & 0x7f));
+      return n;
+    }
+    static size_t encode_ids (const uint32_t* ids, const size_t n, char* key) {
+      size_t len = 0;
+      for (size_t i = 0; i < n; ++i) len += encode_id (ids[i], key + len);
+      return len;
+    }
+    static size_t decode_ids (const char* key, const size_t len, uint32_t* ids) {
+      size_t n = 0;
+      for (size_t pos = 0; pos < len; ++n) {
+        const uchar c = static_cast <uchar> (key[pos++]);
+        size_t m = 1;
+        while (m < MAX_ID_BYTES && c >= _id_head (m + 1)) ++m;
+        uint32_t v = c - _id_head (m);
+        for (; --m && pos < len; ++pos) v = (v << 7) | (static_cast <uchar> (key[pos]) & 0x7f);
+        ids[n] = v;
+      }
+      return n;
+    }
+    value_type& update (const uint32_t* ids, size_t n, value_type val = value_type (0))
+    { bool inserted = false; return update (ids, n, val, inserted); }
+    value_type& update (const uint32_t* ids, size_t n, value_type val, bool& inserted) {
+      const _id_key key (ids, n);
+      return update (key.key, key.len, val, inserted);
+    }
+    template <typename T>
+    T exactMatchSearch (const uint32_t* ids, size_t n) const {
+      union { int i; value_type x; } b;
+      npos_t from = 0;
+      b.i = _find_ids (ids, n, from);
+      if (b.i == CEDAR_NO_PATH) b.i = CEDAR_NO_VALUE;
+      T result;
+      _set_result (&result, b.x, n, from);
+      return result;
+    }
+    template <typename T>
+    size_t commonPrefixSearch (const uint32_t* ids, T* result, size_t result_len, size_t n) const {
+      size_t num = 0;
+      npos_t from = 0;
+      for (size_t i = 0; i < n; ++i) {
+        union { int i; value_type x; } b;
+        b.i = _find_ids (ids + i, 1, from);
+        if (b.i == CEDAR_NO_VALUE) continue;
+        if (b.i == CEDAR_NO_PATH)  return num;
+        if (num < result_len) _set_result (&result[num], b.x, i + 1, from);
+        ++num;
+      }
+      return num;
+    }
+    int erase (const uint32_t* ids, size_t n) {
+      const _id_key key (ids, n);
+      return erase (key.key, key.len);
+    }
     int build (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0) {
       for (size_t i = 0; i < num; ++i)
         update (key[i], len ? len[i] : std::strlen (key[i]), val ? val[i] : value_type (i));
       return 0;
     }
+    // same as build () but faster for sorted keys; see sorted_updater
+    int build_sorted (size_t num, const char** key, const size_t* len = 0, const value_type* val = 0) {
+      sorted_updater u (*this);
+      for (size_t i = 0; i < num; ++i)
+        u.update (key[i], len ? len[i] : std::strlen (key[i]), val ? val[i] : value_type (i));
+      return 0;
+    }
     template <typename T>
     void dump (T* result, const size_t result_len) {
       union { int i; value_type x; } b;
@@ -349,31 +931,305 @@ namespace cedar {
         else
           _err (__FILE__, __LINE__, "dump() needs array of length = num_keys()\n");
     }
-    void shrink_tail () {
-      union { char* tail; int* length; } t;
-      const size_t length_
-        = static_cast <size_t> (*_length)
-        - static_cast <size_t> (*_length0) * (1 + sizeof (value_type));
-      t.tail = static_cast <char*> (std::malloc (length_));
-      if (! t.tail) _err (__FILE__, __LINE__, "memory allocation failed\n");
-      *t.length = static_cast <int> (sizeof (int));
-      for (int to = 0; to < _size; ++to) {
-        node& n = _array[to];
-        if (n.check >= 0 && _array[n.check].base != to && n.base < 0) {
-          char* const tail (&t.tail[*t.length]), * const tail_ (&_tail[-n.base]);
-          n.base = - *t.length;
-          int i = 0; do tail[i] = tail_[i]; while (tail[i++]);
-          *reinterpret_cast <value_type*> (&tail[i])
-            = *reinterpret_cast <const value_type*> (&tail_[i]);
-          *t.length += i + static_cast <int> (sizeof (value_type));
-        }
-      }
-      std::free (_tail);
+    // visitor version of dump ()
+    template <typename V>
+    size_t dumpVisit (V visitor) const {
+      union { int i; value_type x; } b;
+      size_t num (0), p (0);
+      npos_t from = 0;
+      for (b.i = begin (from, p); b.i != CEDAR_NO_PATH; b.i = next (from, p)) {
+        ++num;
+        if (! visitor (b.x, p, from)) break;
+      }
+      return num;
+    }
+    // minimal perfect hash; freeze() builds a rank directory over leaves (terminals and nodes w/ tail),
+    // after which key_id() maps a key to a dense id in [0, num_keys()) and id_to_key() gives the key back.
+    // Ids follow the node order; update() and erase() discard the directory
+    void freeze () {
+      thaw ();
+      const index_type num_blocks = _size >> 8;
+      _realloc_array (_rank, num_blocks);
+      index_type count = 0;
+      for (index_type bi = 0; bi < num_blocks; ++bi) {
+        rank_block& r = _rank[bi];
+        r.count = count;
+        for (int i = 0; i < 256; ++i)
+          if (_is_leaf ((bi << 8) | i)) r.leaf[i >> 6] |= static_cast <uint64_t> (1) << (i & 63), ++count;
+      }
+    }
+    void thaw () { std::free (_rank); _rank = 0; }
+    bool frozen () const { return _rank; }
+    // returns CEDAR_NO_VALUE if key is not in the trie
+    index_type key_id (const char* key) const { return key_id (key, std::strlen (key)); }
+    index_type key_id (const char* key, size_t len) const {
+      if (! _rank) _err (__FILE__, __LINE__, "key_id() needs freeze()\n");
+      npos_t from = 0;
+      size_t pos  = 0;
+      const int i = _find (key, from, pos, len);
+      if (i == CEDAR_NO_PATH || i == CEDAR_NO_VALUE) return CEDAR_NO_VALUE;
+      const index_type to = static_cast <index_type> (from & TAIL_OFFSET_MASK);
+      return _rank_leaf (_array[to].base < 0 ? to : _array[to].base ^ 0);
+    }
+    // returns the node id and length (len) of the key with id, which suffix() takes
+    npos_t id_to_node (const size_t id, size_t& len) const {
+      if (! _rank) _err (__FILE__, __LINE__, "id_to_node() needs freeze()\n");
+      if (id >= static_cast <size_t> (_num_keys)) _err (__FILE__, __LINE__, "id out of range\n");
+      npos_t to = static_cast <npos_t> (_select_leaf (static_cast <index_type> (id)));
+      size_t len_tail = 0;
+      const index_type base = _array[to].base;
+      if (base < 0) { // leaf w/ tail
+        if ((len_tail = _tail_len (&_tail[-base])))
+          to |= static_cast <npos_t> (len_tail + 1) << TAIL_OFFSET_SHIFT;
+      } else // terminal
+        to = static_cast <npos_t> (_array[to].check);
+      len = len_tail;
+      for (index_type n = static_cast <index_type> (to & TAIL_OFFSET_MASK); n; n = _array[n].check) ++len;
+      return to;
+    }
+    // writes the key with id into key if it fits key_len bytes (including '\0'); returns the key length
+    size_t id_to_key (const size_t id, char* key, const size_t key_len) const {
+      size_t len = 0;
+      const npos_t to = id_to_node (id, len);
+      if (len < key_len) suffix (key, len, to);
+      return len;
+    }
+    /*
+     * Compact the tail by dropping free records. With share, a record (suffix, '\0' and value) that is the end of
+     * another one is stored in it, identical ones included, as MARISA merges its tail; only records with the same
+     * value can overlap, so this pays for sets and for keys with a few distinct values (or values kept by key_id ()
+     * elsewhere). Lookups read the tail as before; update () or erase () first gives each key its own record again.
+    */
+    void shrink_tail (const bool share = false) {
+      const bool mapped = _no_delete; // _tail and _array in the memory given by set_array ()
+      if (mapped) _array = _dup (_array, static_cast <size_t> (_size)), _no_delete = false;
+      union { char* tail; index_type* length; } t;
+      if (share)
+        t.tail = _share_tail ();
+      else {
+        size_t length_ = _tail_shared ? sizeof (index_type) // count records one by one
+          : static_cast <size_t> (*_length)
+          - static_cast <size_t> (_free_length);
+        if (_tail_shared)
+          for (index_type to = 0; to < _size; ++to) {
+            const node& n = _array[to];
+            if (_on_tail (to))
+              length_ += _tail_size (_tail_len (&_tail[-n.base]));
+          }
+        t.tail = static_cast <char*> (std::malloc (length_));
+        if (! t.tail) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        *t.length = static_cast <index_type> (sizeof (index_type));
+        for (index_type to = 0; to < _size; ++to) {
+          node& n = _array[to];
+          if (_on_tail (to)) {
+            const char* const tail_ = &_tail[-n.base];
+            const size_t len = _tail_len (tail_);
+            char* const tail = &t.tail[*t.length] + _tail_head (len);
+            n.base = - static_cast <index_type> (tail - t.tail);
+            std::memcpy (tail, tail_, len);
+            _set_tail_len (tail, len);
+            _tail_value (tail, len) = _tail_value (tail_, len);
+            *t.length += static_cast <index_type> (_tail_size (len));
+          }
+        }
+      }
+      if (! mapped) std::free (_tail); // positions on tail, relative to their records, stay valid
       _tail = t.tail;
       _realloc_array (_tail,  *_length,  *_length);
       _quota  = *_length;
-      _realloc_array (_tail0, 1);
-      _quota0 = 1;
+      _clear_tail0 ();
+      _nonzero_length = *_length - static_cast <index_type> (sizeof (index_type));
+      _tail_shared = share;
+    }
+    // payload store; variable-length byte strings in an append-only arena of length-prefixed (varint) records,
+    // referenced from the values of their keys (do not update () such keys by yourself). Records of overwritten or
+    // erased keys stay until compact_payload (). save () writes the arena to fn + ".pld" and open () reads it if any
+    void set_payload (const char* key, size_t len, const void* data, size_t size) {
+      const size_t offset = _append_payload (data, size);
+      if (static_cast <size_t> (static_cast <value_type> (offset)) != offset)
+        _err (__FILE__, __LINE__, "payload store is too large for value_type\n");
+      update (key, len) = static_cast <value_type> (offset);
+    }
+    payload_type get_payload (const char* key) const { return get_payload (key, std::strlen (key)); }
+    payload_type get_payload (const char* key, size_t len) const {
+      const value_type offset = exactMatchSearch <value_type> (key, len);
+      if (offset < 0 || static_cast <size_t> (offset) >= _payload_size) { payload_type p = { 0, 0 }; return p; }
+      return _read_payload (static_cast <size_t> (offset));
+    }
+    // moves the records referenced by keys to a new arena; returns # bytes reclaimed
+    size_t compact_payload () {
+      if (! _payload_size) return 0;
+      if (_tail_shared) shrink_tail ();
+      char* payload = 0;
+      _realloc_array (payload, static_cast <index_type> (_payload_size));
+      size_t size = 0;
+      for (index_type to = 0; to < _size; ++to) {
+        if (! _is_leaf (to)) continue;
+        value_type& offset = _leaf_value (to);
+        if (offset < 0 || static_cast <size_t> (offset) >= _payload_size) continue;
+        const payload_type p = _read_payload (static_cast <size_t> (offset));
+        const size_t n = static_cast <size_t> (p.data - &_payload[offset]) + p.size;
+        std::memcpy (&payload[size], &_payload[offset], n);
+        offset = static_cast <value_type> (size);
+        size += n;
+      }
+      if (! _payload_no_delete) std::free (_payload);
+      const size_t reclaimed = _payload_size - size;
+      _payload = payload;
+      _payload_size = _payload_quota = size;
+      _payload_no_delete = false;
+      return reclaimed;
+    }
+    size_t payload_size () const { return _payload_size; }
+    const void* payload_array () const { return _payload; }
+    void set_payload_array (const void* p, size_t size) { // ad-hoc; call after set_array ()
+      _clear_payload ();
+      _payload = static_cast <char*> (const_cast <void*> (p)); // copied before written
+      _payload_size = _payload_quota = size;
+      _payload_no_delete = true;
+    }
+    // label remapping; see cedar.h. Bytes on tail are kept as is
+    void set_label_map (const uchar* code) {
+      if (_num_keys) _err (__FILE__, __LINE__, "label map must be set on an empty trie\n");
+      _set_label_map (code);
+    }
+    void set_label_map (size_t num, const char** key, const size_t* len = 0) {
+      size_t count[256] = {0};
+      for (size_t i = 0; i < num; ++i) {
+        const uchar* const key_ = reinterpret_cast <const uchar*> (key[i]);
+        for (size_t j = 0, n = len ? len[i] : std::strlen (key[i]); j < n; ++j) ++count[key_[j]];
+      }
+      uchar byte[255], code[256];
+      for (size_t c = 1; c < 256; ++c) { // insertion sort by count, stable
+        size_t j = c - 1;
+        for (; j > 0 && count[byte[j - 1]] < count[c]; --j) byte[j] = byte[j - 1];
+        byte[j] = static_cast <uchar> (c);
+      }
+      code[0] = 0;
+      for (size_t j = 0; j < 255; ++j) code[byte[j]] = static_cast <uchar> (j + 1);
+      set_label_map (code);
+    }
+    const uchar* label_map () const { return _code; }
+    /*
+     * Visit the elements of the array that exactMatchSearch (key) reads, from the root to the terminal
+     * or a node with tail (including the last one that fails to match); visitor (id) is called for each.
+     * This tells how a lookup touches memory, e.g., the number of cache lines or pages; reads of _tail are not visited.
+    */
+    template <typename V>
+    void pathVisit (const char* key, size_t len, V visitor) const {
+      size_t from = 0;
+      visitor (from);
+      for (const uchar* key_ = reinterpret_cast <const uchar*> (key), * const end = key_ + len; key_ != end; ++key_) {
+        if (_array[from].base < 0) return; // tail
+        const size_t to = static_cast <size_t> (_array[from].base) ^ _code[*key_];
+        visitor (to);
+        if (_array[to].check != static_cast <index_type> (from)) return;
+        from = to;
+      }
+      if (_array[from].base < 0) return;
+      visitor (static_cast <size_t> (_array[from].base) ^ 0);
+    }
+    /*
+     * Relayout for cache locality: rebuild the array from scratch with the frequency of nodes read by sample queries
+     * (e.g., a query log). Hot nodes are placed first by a depth-first walk that follows the more frequent child
+     * first, and then the rest in label order; each sibling set goes to the first room after its parent.
+     * Keys, values, tails and counters are kept; node ids change (handles are updated).
+     * Slow; meant for an offline tool (see relayout.cc).
+    */
+    void relayout (size_t num, const char** key, const size_t* len = 0) {
+      if (_rank) thaw ();
+      const size_t size = static_cast <size_t> (_size);
+      size_t* weight = static_cast <size_t*> (std::calloc (size, sizeof (size_t)));
+      size_t* to_    = static_cast <size_t*> (std::malloc (sizeof (size_t) * size)); // new id
+      index_type* base_ = static_cast <index_type*> (std::malloc (sizeof (index_type) * size)); // new base
+      size_t* stack  = static_cast <size_t*> (std::malloc (sizeof (size_t) * size));
+      if (! weight || ! to_ || ! base_ || ! stack) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      _weight_counter counter = { weight };
+      for (size_t i = 0; i < num; ++i)
+        pathVisit (key[i], len ? len[i] : std::strlen (key[i]), counter);
+      for (size_t i = 0; i < size; ++i) base_[i] = -1;
+      _layout layout (size >> 8);
+      layout.use (to_[0] = 0); // root
+      size_t hot_end = 0;
+      for (int cold = 0; cold <= 1; ++cold) {
+        size_t n = 0;
+        stack[n++] = 0;
+        while (n) {
+          const size_t from = stack[--n];
+          if (! _has_child (from) || (! cold && ! weight[from])) continue;
+          const size_t base = static_cast <size_t> (_array[from].base);
+          uchar label[256];
+          short k = 0;
+          for (size_t c = 0; c < 256; ++c)
+            if (_array[base ^ c].check == static_cast <index_type> (from))
+              label[k++] = static_cast <uchar> (c);
+          if (base_[from] < 0 && k) { // place children
+            const size_t start = to_[from] + 1;
+            const size_t b = ! from ? 0 : layout.find (label, k, cold && start < hot_end ? hot_end : start); // root's base stays 0
+            for (short j = 0; j < k; ++j) layout.use (to_[base ^ label[j]] = b ^ label[j]);
+            base_[from] = static_cast <index_type> (b);
+            if (! cold && b + 256 > hot_end) hot_end = (b | 0xff) + 1;
+          }
+          if (cold) // visit children in label order
+            for (short j = k; j > 0; --j) stack[n++] = base ^ label[j - 1];
+          else { // visit hot children, more frequent first
+            const size_t n_ = n;
+            for (short j = 0; j < k; ++j) {
+              const size_t to = base ^ label[j];
+              if (! weight[to]) continue;
+              size_t i = n++;
+              for (; i > n_ && weight[stack[i - 1]] > weight[to]; --i) stack[i] = stack[i - 1];
+              stack[i] = to;
+            }
+          }
+        }
+      }
+      // build the new array
+      const size_t size_ = layout.num_blocks << 8;
+      node* array = static_cast <node*> (std::malloc (sizeof (node) * size_));
+      if (! array) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      for (size_t bi = 0; bi < layout.num_blocks; ++bi) { // link empty elements in each block
+        size_t first = 0, prev = 0;
+        for (size_t e = bi << 8; e < (bi + 1) << 8; ++e) {
+          if (layout.used_at (e)) continue;
+          if (first) array[e].base = - static_cast <index_type> (prev), array[prev].check = - static_cast <index_type> (e);
+          else first = e;
+          prev = e;
+        }
+        if (first) array[first].base = - static_cast <index_type> (prev), array[prev].check = - static_cast <index_type> (first);
+      }
+      for (size_t from = 0; from < size; ++from) {
+        const node& n = _array[from];
+        if (from && n.check < 0) continue;
+        array[to_[from]] = node (base_[from] >= 0 ? base_[from] : n.base, // keep value or tail offset
+                                 from ? static_cast <index_type> (to_[n.check]) : n.check);
+      }
+      for (int h = 0; h < _handle_size; ++h) {
+        npos_t& from = _handle[h].node;
+        const npos_t t = from & TAIL_OFFSET_MASK;
+        if (_handle[h].prev != -2)
+          from = t < size && (! t || _array[t].check >= 0) ? (from & ~TAIL_OFFSET_MASK) | to_[t] : 0;
+      }
+      _relink_handles ();
+      if (_no_delete) { // _tail and _array share the memory given by set_array ()
+        char* tail = static_cast <char*> (std::malloc (static_cast <size_t> (*_length)));
+        if (! tail) _err (__FILE__, __LINE__, "memory allocation failed\n");
+        std::memcpy (tail, _tail, static_cast <size_t> (*_length));
+        _tail = tail;
+        _quota = *_length;
+      } else if (_array) std::free (_array);
+      if (_quota < *_length) _quota = *_length; // opened w/o restore ()
+      _array = array;
+      _no_delete = false;
+      _size = _capacity = static_cast <index_type> (size_);
+      std::free (_ninfo); _ninfo = 0;
+      std::free (_block); _block = 0;
+      _restore_ninfo ();
+      _restore_block ();
+      std::free (weight);
+      std::free (to_);
+      std::free (base_);
+      std::free (stack);
     }
     int save (const char* fn, const char* mode, const bool shrink) {
       if (shrink) shrink_tail ();
@@ -386,16 +1242,30 @@ namespace cedar {
       std::fwrite (_tail,  sizeof (char), static_cast <size_t> (*_length), fp);
       std::fwrite (_array, sizeof (node), static_cast <size_t> (_size), fp);
       std::fclose (fp);
+      if (_save_header (fn, mode) != 0) return -1;
+      const char* const pld = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".pld");
+      if (_payload_size) {
+        fp = std::fopen (pld, mode);
+        delete [] pld;
+        if (! fp) return -1;
+        std::fwrite (_payload, sizeof (char), _payload_size, fp);
+        std::fclose (fp);
+      } else { // or open () would load the payload of an earlier save
+        std::remove (pld);
+        delete [] pld;
+      }
 #ifdef USE_FAST_LOAD
       const char* const info
         = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
       fp = std::fopen (info, mode);
       delete [] info; // resolve memory leak
       if (! fp) return -1;
-      std::fwrite (&_bheadF, sizeof (int), 1, fp);
-      std::fwrite (&_bheadC, sizeof (int), 1, fp);
-      std::fwrite (&_bheadO, sizeof (int), 1, fp);
+      std::fwrite (&_bheadF, sizeof (index_type), 1, fp);
+      std::fwrite (&_bheadC, sizeof (index_type), 1, fp);
+      std::fwrite (&_bheadO, sizeof (index_type), 1, fp);
+#ifndef USE_COLOCATED_NINFO
       std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
+#endif
       std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
       std::fclose (fp);
 #endif
@@ -408,72 +1278,88 @@ namespace cedar {
       if (! fp) return -1;
       // get size
       if (! size_) {
-        if (std::fseek (fp, 0, SEEK_END) != 0) return -1;
-        size_ = static_cast <size_t> (std::ftell (fp));
-        if (std::fseek (fp, 0, SEEK_SET) != 0) return -1;
-      }
-      if (size_ <= offset) return -1;
-      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      int len = 0;
-      if (std::fread (&len, sizeof (int), 1, fp) != 1) return -1;
+        const long end = std::fseek (fp, 0, SEEK_END) == 0 ? std::ftell (fp) : -1;
+        if (end < 0) { std::fclose (fp); return -1; }
+        size_ = static_cast <size_t> (end);
+      }
+      index_type len = 0;
+      if (size_ <= offset || std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0 ||
+          std::fread (&len, sizeof (index_type), 1, fp) != 1)
+        { std::fclose (fp); return -1; }
       const size_t length_ = static_cast <size_t> (len);
-      if (size_ <= offset + length_) return -1;
+      if (size_ <= offset + length_ || ((size_ - offset - length_) / sizeof (node)) & 0xff) // not whole blocks
+        { std::fclose (fp); return -1; }
       // set array
       clear (false);
       size_ = (size_ - offset - length_) / sizeof (node);
       _array = static_cast <node*>  (std::malloc (sizeof (node)  * size_));
       _tail  = static_cast <char*>  (std::malloc (length_));
-      _tail0 = static_cast <int*>   (std::malloc (sizeof (int)));
 #ifdef USE_FAST_LOAD
+#ifndef USE_COLOCATED_NINFO
       _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
+#endif
       _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
-      if (! _array || ! _tail || ! _tail0 || ! _ninfo || ! _block)
+      if (! _array || ! _tail || ! _has_ninfo () || ! _block)
 #else
-      if (! _array || ! _tail || ! _tail0)
+      if (! _array || ! _tail)
 #endif
         _err (__FILE__, __LINE__, "memory allocation failed\n");
-      if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      if (length_ != std::fread (_tail,  sizeof (char), length_, fp) ||
-          size_   != std::fread (_array, sizeof (node), size_,   fp))
-        return -1;
+      bool read = std::fseek (fp, static_cast <long> (offset), SEEK_SET) == 0 &&
+        length_ == std::fread (_tail,  sizeof (char), length_, fp) &&
+        size_   == std::fread (_array, sizeof (node), size_,   fp);
       std::fclose (fp);
-      _size = static_cast <int> (size_);
-      *_length0 = 0;
+      if (! read) return -1;
+      _size = static_cast <index_type> (size_);
+      if (_open_header (fn, mode) != 0 || _open_payload (fn, mode) != 0) return -1;
 #ifdef USE_FAST_LOAD
       const char* const info
         = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
       fp = std::fopen (info, mode);
       delete [] info; // resolve memory leak
       if (! fp) return -1;
-      std::fread (&_bheadF, sizeof (int), 1, fp);
-      std::fread (&_bheadC, sizeof (int), 1, fp);
-      std::fread (&_bheadO, sizeof (int), 1, fp);
-      if (size_      != std::fread (_ninfo, sizeof (ninfo), size_, fp) ||
-          size_ >> 8 != std::fread (_block, sizeof (block), size_ >> 8, fp))
-        return -1;
+      std::fread (&_bheadF, sizeof (index_type), 1, fp);
+      std::fread (&_bheadC, sizeof (index_type), 1, fp);
+      std::fread (&_bheadO, sizeof (index_type), 1, fp);
+      read =
+#ifndef USE_COLOCATED_NINFO
+        size_      == std::fread (_ninfo, sizeof (ninfo), size_, fp) &&
+#endif
+        size_ >> 8 == std::fread (_block, sizeof (block), size_ >> 8, fp);
       std::fclose (fp);
+      if (! read) return -1;
       _capacity = _size;
       _quota  = *_length;
-      _quota0 = 1;
 #endif
       return 0;
     }
 #ifndef USE_FAST_LOAD
     void restore () { // restore information to update
       if (! _block) _restore_block ();
-      if (! _ninfo) _restore_ninfo ();
+      if (! _has_ninfo ()) _restore_ninfo ();
       _capacity = _size;
-      _quota  = *_length;
-      _quota0 = 1;
+      _quota  = *_length; // a stripped trie keeps its free fragments on tail
+    }
+    // the opposite of restore (); a read-only trie needs only the double array and tail
+    // (ninfo co-located with USE_COLOCATED_NINFO stays in the nodes)
+    void strip () {
+#ifndef USE_COLOCATED_NINFO
+      std::free (_ninfo); _ninfo = 0;
+#endif
+      std::free (_block); _block = 0;
     }
 #endif
     // remove all the keys while keeping the memoryallocation
     void reset() {
+      thaw ();
+      _clear_payload ();
+      _set_label_map (0);
       // initialize existing arrays while keeping the size
       _realloc_array(_array, _capacity, 256);
       _realloc_array(_tail, _quota);
-      _realloc_array(_tail0, _quota0);
+      _clear_tail0 ();
+#ifndef USE_COLOCATED_NINFO
       _realloc_array(_ninfo, _capacity);
+#endif
       _realloc_array(_block, _capacity >> 8);
 
       // initialize first block
@@ -485,99 +1371,191 @@ namespace cedar {
 
       _size = 256;
       _block[0].ehead = 1; // bug fix for erase
-      *_length = static_cast <int> (sizeof (int));
+      _set_empty (0, false); // root
+      *_length = static_cast <index_type> (sizeof (index_type));
       _bheadF = _bheadC = _bheadO = 0;
-      for (size_t i = 0; i <= NUM_TRACKING_NODES; ++i)
-        tracking_node[i] = 0;
+      _num_keys = _nonzero_size = _nonzero_length = 0;
+      _tail_shared = false;
+      for (int h = 0; h < _handle_size; ++h) _handle[h].node = 0;
+      _relink_handles ();
       for (short i = 0; i <= 256; ++i)
         _reject[i] = i + 1;
     }
 
-    void set_array (void* p, size_t size_ = 0) { // ad-hoc
+    // fn, if given, is the file the array was saved to; its counters and label map are taken from <fn>.hdr
+    int set_array (void* p, size_t size_ = 0, const char* fn = 0) { // ad-hoc; -1 if <fn>.hdr is broken
       clear (false);
       if (size_)
-        size_ = size_ * unit_size () - static_cast <size_t> (*static_cast <int*> (p));
+        size_ = size_ * unit_size () - static_cast <size_t> (*static_cast <index_type*> (p));
       _tail  = static_cast <char*> (p);
       _array = reinterpret_cast <node*> (_tail + *_length);
-      _size  = static_cast <int> (size_ / unit_size () + (size_ % unit_size () ? 1 : 0));
+      _size  = static_cast <index_type> (size_ / unit_size () + (size_ % unit_size () ? 1 : 0));
+      _size &= ~static_cast <index_type> (0xff);
       _no_delete = true;
+      if (fn) return _open_header (fn, "rb");
+      _set_counter (0);
+      return 0;
     }
     const void* array () const { return _array; }
     void clear (const bool reuse = true) {
       if (_no_delete) _array = 0, _tail = 0;
-      if (_array) std::free (_array); _array = 0;
-      if (_tail)  std::free (_tail);  _tail  = 0;
-      if (_tail0) std::free (_tail0); _tail0 = 0;
-      if (_ninfo) std::free (_ninfo); _ninfo = 0;
-      if (_block) std::free (_block); _block = 0;
-      _bheadF = _bheadC = _bheadO = _capacity = _size = _quota = _quota0 = 0;
+      std::free (_array); _array = 0;
+      std::free (_tail);  _tail  = 0;
+      _clear_tail0 ();
+      std::free (_ninfo); _ninfo = 0;
+      std::free (_block); _block = 0;
+      thaw ();
+      _clear_payload ();
+      _set_label_map (0);
+      _bheadF = _bheadC = _bheadO = _capacity = _size = _quota = 0;
+      _num_keys = _nonzero_size = _nonzero_length = 0;
+      _tail_shared = false;
+      for (int h = 0; h < _handle_size; ++h) _handle[h].node = 0;
+      _relink_handles ();
       if (reuse) _initialize ();
       _no_delete = false;
     }
     // return the first child for a tree rooted by a given node
     int begin (npos_t& from, size_t& len) {
 #ifndef USE_FAST_LOAD
-      if (! _ninfo) _restore_ninfo ();
+      if (! _has_ninfo ()) _restore_ninfo ();
 #endif
-      int base = from >> 32 ? - static_cast <int> (from >> 32) : _array[from].base;
-      if (base >= 0) { // on trie
-        uchar c = _ninfo[from].child;
-        if (! from && ! (c = _ninfo[base ^ c].sibling)) // bug fix
-          return CEDAR_NO_PATH; // no entry
+      return static_cast <const da&> (*this).begin (from, len);
+    }
+    // const version never restores ninfo; child labels are probed if ninfo is missing
+    int begin (npos_t& from, size_t& len) const {
+      const npos_t k = from >> TAIL_OFFSET_SHIFT;
+      index_type base = _array[from & TAIL_OFFSET_MASK].base;
+      if (! k && base >= 0) { // on trie
+        uchar c = _child (from, base);
+        if (! from && ! c) return CEDAR_NO_PATH; // no entry
         for (; c && base >= 0; ++len) {
           from = static_cast <size_t> (base) ^ c;
           base = _array[from].base;
-          c    = _ninfo[from].child;
+          c    = _child (from, base);
         }
-        if (base >= 0) return _array[base ^ c].base;
+        if (base >= 0) return *reinterpret_cast <const int*> (&_array[base ^ c].value);
       }
-      const size_t len_ = std::strlen (&_tail[-base]);
+      const size_t offset = k ? _tail_offset (from) : static_cast <size_t> (-base);
       from &= TAIL_OFFSET_MASK;
-      from |= static_cast <npos_t> (static_cast <size_t> (-base) + len_) << 32;
-      len += len_;
-      return *reinterpret_cast <int*> (&_tail[-base] + len_ + 1);
+      const size_t end = _tail_end (from);
+      len += end - offset;
+      from = _tail_npos (from, end);
+      return *reinterpret_cast <const int*> (&_tail[end + TAIL_TERM]);
     }
     // return the next child if any
     int next (npos_t& from, size_t& len, const npos_t root = 0) {
+#ifndef USE_FAST_LOAD
+      if (! _has_ninfo ()) _restore_ninfo ();
+#endif
+      return static_cast <const da&> (*this).next (from, len, root);
+    }
+    int next (npos_t& from, size_t& len, const npos_t root = 0) const {
       uchar c = 0;
-      if (const int offset = static_cast <int> (from >> 32)) { // on tail
-        if (root >> 32) return CEDAR_NO_PATH;
+      if (const npos_t k = from >> TAIL_OFFSET_SHIFT) { // on tail
+        if (root >> TAIL_OFFSET_SHIFT) return CEDAR_NO_PATH;
         from &= TAIL_OFFSET_MASK;
-        len -= static_cast <size_t> (offset - (-_array[from].base));
+        len -= static_cast <size_t> (k - 1);
       } else
-        c    = _ninfo[_array[from].base ^ 0].sibling;
+        c    = _sibling (static_cast <npos_t> (_array[from].base ^ 0), from);
       for (; ! c && from != root; --len) {
-        c    = _ninfo[from].sibling;
+        const npos_t to = from;
         from = static_cast <size_t> (_array[from].check);
+        c    = _sibling (to, from);
       }
       if (! c) return CEDAR_NO_PATH;
       return begin (from = static_cast <size_t> (_array[from].base) ^ c, ++len) ;
     }
-    npos_t tracking_node[NUM_TRACKING_NODES + 1];
+    /*
+     * Handles are cursors (node ids or positions on tail as given to and returned by traverse () or update ()) that
+     * stay valid while update () relocates nodes or splits tails; a node moved by _resolve () carries its handles
+     * in O(1) through a hash table from node ids to handles. Any number of handles can be kept; clear () and
+     * reset () move all of them back to the root.
+    */
+    size_t add_handle (const npos_t from = 0) { // register a cursor; returns its handle
+      int h = _handle_free;
+      if (h >= 0) _handle_free = _handle[h].next;
+      else {
+        if (_handle_size == _handle_quota) {
+          _handle_quota = _handle_quota ? _handle_quota << 1 : 16;
+          _realloc_array (_handle, _handle_quota, _handle_size);
+        }
+        h = _handle_size++;
+      }
+      _handle[h].node = from;
+      _link_handle (h);
+      ++_num_handles;
+      return static_cast <size_t> (h);
+    }
+    npos_t handle_node (const size_t h) const { return _handle[h].node; }
+    void set_handle (const size_t h, const npos_t from) { // move a cursor, e.g., after traverse ()
+      _unlink_handle (static_cast <int> (h));
+      _handle[h].node = from;
+      _link_handle (static_cast <int> (h));
+    }
+    void erase_handle (const size_t h) {
+      _unlink_handle (static_cast <int> (h));
+      _handle[h].prev = -2; // unused
+      _handle[h].next = _handle_free;
+      _handle_free = static_cast <int> (h);
+      --_num_handles;
+    }
+    size_t num_handles () const { return static_cast <size_t> (_num_handles); }
 
   private:
-    // currently disabled; implement these if you need
+    // disabled; see clone ()
     da (const da&);
     da& operator= (const da&);
     node*   _array;
-    union { char* _tail;  int* _length;  };
-    union { int*  _tail0; int* _length0; };
+    union { char* _tail;  index_type* _length;  };
+    tail_frag* _tail0; // free fragments on tail; _tail0[c].next heads size class c and _tail0[0].next unused entries
     ninfo*  _ninfo;
     block*  _block;
-    int     _bheadF;  // first block of Full;   0
-    int     _bheadC;  // first block of Closed; 0 if no Closed
-    int     _bheadO;  // first block of Open;   0 if no Open
-    int     _capacity;
-    int     _size;
-    int     _quota;
-    int     _quota0;
+    index_type _bheadF;  // first block of Full;   0
+    index_type _bheadC;  // first block of Closed; 0 if no Closed
+    index_type _bheadO;  // first block of Open;   0 if no Open
+    rank_block* _rank; // 0 unless frozen
+    index_type _capacity;
+    index_type _size;
+    index_type _quota;
+    index_type _quota0;
+    index_type _size0;
+    index_type _num_keys;
+    index_type _nonzero_size;
+    index_type _nonzero_length;  // bytes of live records on tail
+    index_type _free_length;     // bytes of free fragments on tail
+    uint64_t   _tail_mask[2];    // non-empty size classes
+    bool    _tail_shared;     // records on tail may be shared; see shrink_tail ()
     int     _no_delete;
+    char*   _payload;  // payload store
+    size_t  _payload_size;
+    size_t  _payload_quota;
+    bool    _payload_no_delete;
     short   _reject[257];
+    uchar   _code[256];    // label of a key byte
+    uchar   _decode[256];  // key byte of a label
+    bool    _remapped;     // _code is not identity
+    handle_rec*  _handle;  // handles; see add_handle ()
+    int     _handle_size;
+    int     _handle_quota;
+    int     _handle_free;  // first unused handle; -1 if none
+    int     _num_handles;
+    handle_slot* _hslot;   // node id -> its first handle; open addressing
+    int     _hslot_size;   // power of 2
+    int     _hslot_used;
     //
     static void _err (const char* fn, const int ln, const char* msg)
     { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
     template <typename T>
-    static void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
+    static T* _dup (const T* p, const size_t n) { // 0 if nothing to copy
+      if (! p || ! n) return 0;
+      T* q = static_cast <T*> (std::malloc (sizeof (T) * n));
+      if (! q) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      std::memcpy (static_cast <void*> (q), p, sizeof (T) * n);
+      return q;
+    }
+    template <typename T>
+    static void _realloc_array (T*& p, const index_type size_n, const index_type size_p = 0) {
       void* tmp = std::realloc (p, sizeof (T) * static_cast <size_t> (size_n));
       if (! tmp)
         std::free (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
@@ -587,45 +1565,238 @@ namespace cedar {
     }
     void _initialize () { // initilize the first special block
       _realloc_array (_array, 256, 256);
-      _realloc_array (_tail,  sizeof (int));
-      _realloc_array (_tail0, 1);
+      _realloc_array (_tail,  sizeof (index_type));
+      _clear_tail0 ();
+#ifndef USE_COLOCATED_NINFO
       _realloc_array (_ninfo, 256);
+#endif
       _realloc_array (_block, 1);
       _array[0] = node (0, -1);
       for (int i = 1; i < 256; ++i)
         _array[i] = node (i == 1 ? -255 : - (i - 1), i == 255 ? -1 : - (i + 1));
       _block[0].ehead = 1; // bug fix for erase
+      _set_empty (0, false); // root
       _capacity = _size = 256;
-      _quota  = *_length  = static_cast <int> (sizeof (int));
-      _quota0 = 1;
-      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = 0;
+      _quota  = *_length  = static_cast <index_type> (sizeof (index_type));
+      _num_keys = _nonzero_size = _nonzero_length = 0;
       for (short  i = 0; i <= 256; ++i) _reject[i] = i + 1;
     }
     // follow/create edge
     template <typename T>
-    int _follow (npos_t& from, const uchar& label, T& cf) {
-      int to = 0;
-      const int base = _array[from].base;
+    index_type _follow (npos_t& from, const uchar& label, T& cf) {
+      index_type to = 0;
+      const index_type base = _array[from].base;
       if (base < 0 || _array[to = base ^ label].check < 0) {
-        to = _pop_enode (base, label, static_cast <int> (from));
+        to = _pop_enode (base, label, static_cast <index_type> (from));
         _push_sibling (from, to ^ label, label, base >= 0);
-      } else if (_array[to].check != static_cast <int> (from))
+      } else if (_array[to].check != static_cast <index_type> (from))
         to = _resolve (from, base, label, cf);
       return to;
     }
+    // encoded integer sequence key; on stack for short sequences
+    struct _id_key {
+      char   buf[MAX_ID_BYTES * 8];
+      char*  key;
+      size_t len;
+      _id_key (const uint32_t* ids, const size_t n) : key (buf), len (0) {
+        if (n > 8 && ! (key = static_cast <char*> (std::malloc (n * MAX_ID_BYTES))))
+          _err (__FILE__, __LINE__, "memory allocation failed\n");
+        len = encode_ids (ids, n, key);
+      }
+      ~_id_key () { if (key != buf) std::free (key); }
+    private:
+      _id_key (const _id_key&);
+      _id_key& operator= (const _id_key&);
+    };
+    // first byte of the code of an id taking n bytes
+    static unsigned _id_head (const size_t n) { return 0x101 - (0x100u >> (n - 1)); }
+    // _find () for a sequence of ids; from is the node (or position on tail) after the last id
+    int _find_ids (const uint32_t* ids, const size_t n, npos_t& from) const {
+      if (! n) return CEDAR_NO_PATH;
+      int i = CEDAR_NO_PATH;
+      for (size_t j = 0; j < n; ++j) {
+        char key[MAX_ID_BYTES];
+        size_t pos = 0;
+        i = _find (key, from, pos, encode_id (ids[j], key));
+        if (i == CEDAR_NO_PATH) break;
+      }
+      return i;
+    }
+    // node in this trie (or its ancestor at depth) and node in the merged one, and the last child label visited
+    struct _merge_frame { npos_t from, from_; int label; size_t depth; };
+    struct _merge_callback { // remap the nodes on the path of merge () if moved
+      _merge_frame* path;
+      size_t        n;
+      void operator () (const index_type from, const index_type to) {
+        for (size_t i = 0; i < n; ++i) // an ancestor is shared by the frames below it
+          if (path[i].from == static_cast <npos_t> (from)) path[i].from = static_cast <npos_t> (to);
+      }
+    };
+    // the key ends at a node of the path; a node just created has no tail to keep
+    template <typename F, typename T>
+    void _merge_terminal (npos_t& from, const value_type val, F& combine, T& cf) {
+      bool inserted = true;
+      index_type to = 0;
+      if (_array[from].base >= 0) to = _follow_terminal (from, cf, inserted);
+      else to = _follow (from, 0, cf), ++_num_keys;
+      _array[to].value = inserted ? val : combine (_array[to].value, val);
+    }
+    template <typename F, typename T>
+    void _merge_key (const char* key, const size_t len, npos_t from, const value_type val, F& combine, T& cf) {
+      bool inserted = false;
+      size_t pos = 0;
+      value_type& v = update (key, from, pos, len, value_type (0), cf, inserted);
+      v = inserted ? val : combine (v, val);
+    }
+    // nodes in this trie and t, the last child label visited, and whether the children of t are done
+    struct _diff_frame { npos_t from, from_; int label; bool removed; };
+    template <typename V>
+    struct _diff_state { // key buffer and event counter of _diff ()
+      V&     visitor;
+      bool   all; // unchanged keys too
+      bool   stop;
+      size_t num;
+      char*  key;
+      int    capacity;
+      _diff_state (V& visitor_, const bool all_) : visitor (visitor_), all (all_), stop (false), num (0), key (0), capacity (0) {}
+      ~_diff_state () { std::free (key); }
+      void reserve (const size_t len) {
+        if (static_cast <int> (len) < capacity) return;
+        const int capacity_ = capacity;
+        while (capacity <= static_cast <int> (len)) capacity = capacity ? capacity << 1 : 256;
+        _realloc_array (key, capacity, capacity_);
+      }
+      void emit (const size_t len, const value_type old_value, const value_type new_value) {
+        if (stop || (old_value == new_value && (! all || old_value == CEDAR_NO_VALUE))) return;
+        key[len] = '\0';
+        ++num;
+        if (! visitor (static_cast <const char*> (key), len, old_value, new_value)) stop = true;
+      }
+    };
+    struct _set_op_visitor { // intersect () and subtract ()
+      da*  r;
+      bool common;
+      bool operator () (const char* key, const size_t len, const value_type old_value, const value_type new_value) {
+        if (old_value != CEDAR_NO_VALUE && (new_value != CEDAR_NO_VALUE) == common) r->update (key, len) = old_value;
+        return true;
+      }
+    };
+    template <typename V>
+    size_t _diff (const da& t, V& visitor, const bool all) const {
+      _diff_state <V> s (visitor, all);
+      int capacity = 16, n = 0;
+      _diff_frame* path = 0;
+      _realloc_array (path, capacity);
+      const _diff_frame root = { 0, 0, -1, false };
+      path[n++] = root;
+      while (n && ! s.stop) {
+        _diff_frame& f = path[n - 1];
+        const size_t d = static_cast <size_t> (n - 1); // depth
+        const da& u = f.removed ? *this : t; // children of t, then those of this trie missing in t
+        const npos_t from = f.removed ? f.from : f.from_;
+        const index_type base = u._array[from].base;
+        uchar c = 0;
+        if (f.label < 0) {
+          if (d && ! f.removed) s.reserve (d), s.emit (d, _terminal (f.from), t._terminal (f.from_));
+          if (! (c = u._child (from, base)) && from) c = u._sibling (static_cast <npos_t> (base ^ 0), from); // skip terminal
+        } else
+          c = u._sibling (static_cast <npos_t> (base ^ f.label), from);
+        if (! c) {
+          if (f.removed) --n; else f.removed = true, f.label = -1;
+          continue;
+        }
+        f.label = c;
+        const uchar byte = u._decode[c];
+        s.reserve (d + 1);
+        s.key[d] = static_cast <char> (byte);
+        const npos_t to = static_cast <npos_t> (base ^ c);
+        if (f.removed) {
+          if (t._child_of (f.from_, byte) < 0) _diff_subtree (s, *this, to, d + 1, true);
+          continue;
+        }
+        const index_type to_ = _child_of (f.from, byte);
+        if (to_ < 0) { _diff_subtree (s, t, to, d + 1, false); continue; }
+        const index_type b = _array[to_].base, b_ = t._array[to].base;
+        if (b < 0 && b_ < 0) { // both on tail
+          const char* const tail = &_tail[-b], * const tail_ = &t._tail[-b_];
+          const size_t len = _tail_len (tail), len_ = _tail_len (tail_);
+          const value_type v = _tail_value (tail, len), v_ = _tail_value (tail_, len_);
+          s.reserve (d + 1 + (len < len_ ? len_ : len));
+          std::memcpy (s.key + d + 1, tail, len);
+          if (len == len_ && std::memcmp (tail, tail_, len) == 0) { s.emit (d + 1 + len, v, v_); continue; }
+          s.emit (d + 1 + len, v, CEDAR_NO_VALUE);
+          std::memcpy (s.key + d + 1, tail_, len_);
+          s.emit (d + 1 + len_, CEDAR_NO_VALUE, v_);
+          continue;
+        }
+        if (b < 0) {
+          const char* const tail = &_tail[-b];
+          const size_t len = _tail_len (tail);
+          _diff_subtree (s, t, to, d + 1, false, tail, len, _tail_value (tail, len));
+          continue;
+        }
+        if (b_ < 0) {
+          const char* const tail_ = &t._tail[-b_];
+          const size_t len_ = _tail_len (tail_);
+          _diff_subtree (s, *this, static_cast <npos_t> (to_), d + 1, true, tail_, len_, _tail_value (tail_, len_));
+          continue;
+        }
+        if (n == capacity) _realloc_array (path, capacity << 1, capacity), capacity <<= 1;
+        const _diff_frame next = { static_cast <npos_t> (to_), to, -1, false };
+        path[n++] = next;
+      }
+      std::free (path);
+      return s.num;
+    }
+    // report the keys below node root (at depth) of trie u as removed (u is this trie) or added; a key of the other
+    // trie ending with suffix (of len_) and val, if given, is compared with them
+    template <typename V>
+    static void _diff_subtree (_diff_state <V>& s, const da& u, const npos_t root, const size_t depth, const bool removed,
+                               const char* suffix = 0, const size_t len_ = 0, const value_type val = CEDAR_NO_VALUE) {
+      union { int i; value_type x; } b;
+      bool found = false;
+      npos_t from (root);
+      size_t len (depth);
+      for (b.i = u.begin (from, len); b.i != CEDAR_NO_PATH && ! s.stop; b.i = u.next (from, len, root)) {
+        s.reserve (len);
+        u.suffix (s.key, len, from);
+        const bool same = suffix && len == depth + len_ && std::memcmp (s.key + depth, suffix, len_) == 0;
+        found |= same;
+        const value_type other = same ? val : static_cast <value_type> (CEDAR_NO_VALUE);
+        s.emit (len, removed ? b.x : other, removed ? other : b.x);
+      }
+      if (suffix && ! found) {
+        s.reserve (depth + len_);
+        std::memcpy (s.key + depth, suffix, len_);
+        s.emit (depth + len_, removed ? CEDAR_NO_VALUE : val, removed ? val : CEDAR_NO_VALUE);
+      }
+    }
+    // child of from by a key byte, or -1
+    index_type _child_of (const npos_t from, const uchar byte) const {
+      const index_type base = _array[from].base;
+      if (base < 0) return -1; // tail
+      const index_type to = base ^ _code[byte];
+      return _array[to].check == static_cast <index_type> (from) ? to : -1;
+    }
+    // value of the key ending at from, or CEDAR_NO_VALUE
+    value_type _terminal (const npos_t from) const {
+      const index_type base = _array[from].base;
+      if (base < 0 || _array[base ^ 0].check != static_cast <index_type> (from)) return CEDAR_NO_VALUE;
+      return _array[base ^ 0].value;
+    }
     // find key from double array
     int _find (const char* key, npos_t& from, size_t& pos, const size_t len) const {
-      npos_t offset = from >> 32;
+      npos_t offset = from >> TAIL_OFFSET_SHIFT ? _tail_offset (from) : 0;
       if (! offset) { // node on trie
         for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
              _array[from].base >= 0; ) {
           if (pos == len) {
             const node& n = _array[_array[from].base ^ 0];
-            if (n.check != static_cast <int> (from)) return CEDAR_NO_VALUE;
-            return n.base;
+            if (n.check != static_cast <index_type> (from)) return CEDAR_NO_VALUE;
+            return *reinterpret_cast <const int*> (&n.value);
           }
-          size_t to = static_cast <size_t> (_array[from].base); to ^= key_[pos];
-          if (_array[to].check != static_cast <int> (from)) return CEDAR_NO_PATH;
+          size_t to = static_cast <size_t> (_array[from].base); to ^= _code[key_[pos]];
+          if (_array[to].check != static_cast <index_type> (from)) return CEDAR_NO_PATH;
           ++pos;
           from = to;
         }
@@ -634,49 +1805,623 @@ namespace cedar {
       // switch to _tail to match suffix
       const size_t pos_orig = pos; // start position in reading _tail
       const char* const tail = &_tail[offset] - pos;
+#ifdef USE_BINARY_TAIL
+      const size_t end = pos + (_tail_end (from & TAIL_OFFSET_MASK) - offset); // key position at the tail end
+      if (pos < len) {
+        pos += _match (key + pos, tail + pos, (len < end ? len : end) - pos);
+        if (const npos_t moved = pos - pos_orig)
+          from = _tail_npos (from & TAIL_OFFSET_MASK, offset + moved);
+        if (pos < len) return CEDAR_NO_PATH; // input > tail, input != tail
+      }
+      if (pos < end) return CEDAR_NO_VALUE;  // input < tail
+      return *reinterpret_cast <const int*> (&tail[len]);
+#else
       if (pos < len) {
         do if (key[pos] != tail[pos]) break; while (++pos < len);
-        if (const npos_t moved = pos - pos_orig) {
-          from &= TAIL_OFFSET_MASK;
-          from |= (offset + moved) << 32;
-        }
+        if (const npos_t moved = pos - pos_orig)
+          from = _tail_npos (from & TAIL_OFFSET_MASK, offset + moved);
         if (pos < len) return CEDAR_NO_PATH; // input > tail, input != tail
       }
       if (tail[pos]) return CEDAR_NO_VALUE;  // input < tail
       return *reinterpret_cast <const int*> (&tail[len + 1]);
+#endif
     }
-#ifndef USE_FAST_LOAD
+    // tail records; [suffix]['\0'][value], or [suffix length in varint, written backward][suffix][value] with
+    // USE_BINARY_TAIL. -base of a node points to its suffix in either case
+#ifdef USE_BINARY_TAIL
+    enum { TAIL_TERM = 0 };
+    static size_t _tail_len (const char* s) {
+      const uchar* p = reinterpret_cast <const uchar*> (s);
+      size_t len = *--p & 0x7f;
+      for (int shift = 7; *p & 0x80; shift += 7)
+        len |= static_cast <size_t> (*--p & 0x7f) << shift;
+      return len;
+    }
+    static size_t _tail_head (size_t len) { size_t n = 1; while (len >>= 7) ++n; return n; }
+    static void _set_tail_len (char* s, size_t len) {
+      for (; len >> 7; len >>= 7) *--s = static_cast <char> ((len & 0x7f) | 0x80);
+      *--s = static_cast <char> (len);
+    }
+    bool _is_tail_end (const npos_t node, const npos_t pos) const { return pos == _tail_end (node); }
+#else
+    enum { TAIL_TERM = 1 };
+    static size_t _tail_len (const char* s) { return std::strlen (s); }
+    static size_t _tail_head (size_t) { return 0; }
+    static void _set_tail_len (char* s, size_t len) { s[len] = '\0'; }
+    bool _is_tail_end (const npos_t, const npos_t pos) const { return ! _tail[pos]; }
+#endif
+    static size_t _tail_size (size_t len) { return _tail_head (len) + len + TAIL_TERM + sizeof (value_type); }
+    static value_type& _tail_value (char* s, size_t len)
+    { return *reinterpret_cast <value_type*> (s + len + TAIL_TERM); }
+    static const value_type& _tail_value (const char* s, size_t len)
+    { return *reinterpret_cast <const value_type*> (s + len + TAIL_TERM); }
+    // end of the suffix of a node with tail
+    size_t _tail_end (const npos_t node) const {
+      const size_t s = static_cast <size_t> (-_array[node].base);
+      return s + _tail_len (&_tail[s]);
+    }
+    // a position on tail from and its offset on _tail; see TAIL_OFFSET_SHIFT
+    size_t _tail_offset (const npos_t from) const {
+      return static_cast <size_t> (-_array[from & TAIL_OFFSET_MASK].base)
+        + static_cast <size_t> (from >> TAIL_OFFSET_SHIFT) - 1;
+    }
+    npos_t _tail_npos (const npos_t node, const size_t offset) const {
+      return node | static_cast <npos_t> (offset - static_cast <size_t> (-_array[node].base) + 1) << TAIL_OFFSET_SHIFT;
+    }
+    // free fragments on tail, in size classes of exact sizes below 64 bytes and then eight per power of 2 (as
+    // TLSF); update () takes one of the exact size or the first one in the classes above, putting the rest back.
+    // The free fragments too small for any record and those lost for being smaller than the smallest record are
+    // dropped by shrink_tail (), which update () calls once such dead bytes outnumber both the live bytes and
+    // the nodes, so that the scan is paid by the updates that left them
+    enum { TAIL_CLASSES = 128 };
+    static size_t _tail_class (const size_t size) {
+      if (size < 64) return size;
+      size_t b = 6;
+      while (b < 13 && size >> (b + 1)) ++b;
+      return b == 13 ? TAIL_CLASSES - 1 : 64 + ((b - 6) << 3) + ((size >> (b - 3)) & 7);
+    }
+    void _push_tail (const size_t offset, const size_t size) {
+      if (size < _tail_size (0)) return; // lost
+      if (! _size0) {
+        _quota0 = _size0 = TAIL_CLASSES;
+        _realloc_array (_tail0, _quota0);
+      }
+      index_type e = _tail0[0].next;
+      if (e)
+        _tail0[0].next = _tail0[e].next;
+      else {
+        if (_size0 == _quota0) {
+#ifdef USE_EXACT_FIT
+          _quota0 += _size0 >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : _size0;
+#else
+          _quota0 += _quota0;
+#endif
+          _realloc_array (_tail0, _quota0, _size0);
+        }
+        e = _size0++;
+      }
+      const size_t c = _tail_class (size);
+      tail_frag& f = _tail0[e];
+      f.offset = static_cast <index_type> (offset);
+      f.size   = static_cast <index_type> (size);
+      f.next   = _tail0[c].next;
+      _tail0[c].next = e;
+      _tail_mask[c >> 6] |= static_cast <uint64_t> (1) << (c & 63);
+      _free_length += f.size;
+    }
+    bool _pop_tail (const size_t size, size_t& offset) {
+      if (! _free_length) return false;
+      size_t c = _tail_class (size);
+      index_type e = _tail0[c].next;
+      if (! e || static_cast <size_t> (_tail0[e].size) < size) { // the first fragment in the classes above
+        e = 0;
+        for (size_t c_ = c + 1; ! e && c_ < TAIL_CLASSES; c_ = (c_ | 63) + 1)
+          if (const uint64_t m = _tail_mask[c_ >> 6] >> (c_ & 63) << (c_ & 63))
+            e = _tail0[c = (c_ & ~static_cast <size_t> (63)) + _ctz (m)].next;
+        if (! e || static_cast <size_t> (_tail0[e].size) < size) return false; // the last class
+      }
+      tail_frag& f = _tail0[e];
+      if (! (_tail0[c].next = f.next)) _tail_mask[c >> 6] &= ~(static_cast <uint64_t> (1) << (c & 63));
+      f.next = _tail0[0].next;
+      _tail0[0].next = e;
+      _free_length -= f.size;
+      offset = static_cast <size_t> (f.offset);
+      _push_tail (offset + size, static_cast <size_t> (f.size) - size); // f may move
+      return true;
+    }
+    void _clear_tail0 () {
+      std::free (_tail0);
+      _tail0 = 0;
+      _size0 = _quota0 = _free_length = 0;
+      _tail_mask[0] = _tail_mask[1] = 0;
+    }
+    // whether node to is a leaf with a record on tail; a node just made by _follow () has base -1 and none yet,
+    // which matters when update () compacts the tail while merge () or sorted_updater holds such a node
+    bool _on_tail (const index_type to) const {
+      const node& n = _array[to];
+      return n.check >= 0 && _array[n.check].base != to && - n.base >= static_cast <index_type> (sizeof (index_type));
+    }
+    bool _tail_dead () const {
+      const index_type dead = *_length - static_cast <index_type> (sizeof (index_type)) - _nonzero_length;
+      return dead > _nonzero_length && dead > _size;
+    }
+    // length of the common prefix of a and b within n bytes, a word at a time
+    static size_t _match (const char* a, const char* b, const size_t n) {
+      size_t i = 0;
+#if defined (__GNUC__) && defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      for (uint64_t x, y; i + sizeof (uint64_t) <= n; i += sizeof (uint64_t)) {
+        std::memcpy (&x, a + i, sizeof (uint64_t));
+        std::memcpy (&y, b + i, sizeof (uint64_t));
+        if (x != y) return i + static_cast <size_t> (__builtin_ctzll (x ^ y) >> 3);
+      }
+#endif
+      while (i < n && a[i] == b[i]) ++i;
+      return i;
+    }
+    // ninfo of a node; in the node itself with USE_COLOCATED_NINFO
+#ifdef USE_COLOCATED_NINFO
+    ninfo&       _info (const size_t i)       { return _array[i].info; }
+    const ninfo& _info (const size_t i) const { return _array[i].info; }
+    bool _has_ninfo () const { return true; }
+#else
+    ninfo&       _info (const size_t i)       { return _ninfo[i]; }
+    const ninfo& _info (const size_t i) const { return _ninfo[i]; }
+    bool _has_ninfo () const { return _ninfo; }
+#endif
+    // first child label of from (for the root, the first label following the terminal one)
+    uchar _child (const npos_t from, const index_type base) const {
+      if (_has_ninfo ())
+        return from ? _info (from).child : _info (base ^ _info (from).child).sibling;
+      return _probe (from, base, from ? 0 : 1);
+    }
+    // label of the right sibling of to (a child of from)
+    uchar _sibling (const npos_t to, const npos_t from) const {
+      if (_has_ninfo ()) return _info (to).sibling;
+      const index_type base = _array[from].base;
+      const int label = static_cast <int> (base ^ static_cast <index_type> (to));
+      return label == 255 ? 0 : _probe (from, base, label + 1);
+    }
+    // ninfo-free enumeration of children for immutable tries; labels come in ascending order
+    uchar _probe (const npos_t from, const index_type base, int label) const {
+      if (base >= 0)
+        for (; label < 256; ++label)
+          if (_array[base ^ label].check == static_cast <index_type> (from))
+            return static_cast <uchar> (label);
+      return 0;
+    }
+    // also used by relayout () with USE_FAST_LOAD
     void _restore_ninfo () {
+#ifdef USE_COLOCATED_NINFO
+      for (index_type i = 0; i < _size; ++i) _array[i].info = ninfo ();
+#else
       _realloc_array (_ninfo, _size);
-      for (int to = 0; to < _size; ++to) {
-        const int from = _array[to].check;
+#endif
+      for (index_type to = 0; to < _size; ++to) {
+        const index_type from = _array[to].check;
         if (from < 0) continue; // skip empty node
-        const int base = _array[from].base;
+        const index_type base = _array[from].base;
         if (const uchar label = static_cast <uchar> (base ^ to)) // skip leaf
           _push_sibling (static_cast <size_t> (from), base, label,
-                         ! from || _ninfo[from].child || _array[base ^ 0].check == from);
+                         ! from || _info (from).child || _array[base ^ 0].check == from);
       }
     }
     void _restore_block () {
       _realloc_array (_block, _size >> 8);
       _bheadF = _bheadC = _bheadO = 0;
-      for (int bi (0), e (0); e < _size; ++bi) { // register blocks to full
+      for (index_type bi (0), e (0); e < _size; ++bi) { // register blocks to full
         block& b = _block[bi];
         b.num = 0;
-        for (; e < (bi << 8) + 256; ++e)
-          if (_array[e].check < 0 && ++b.num == 1) b.ehead = e;
-        int& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
+        for (; e < (bi << 8) + 256; ++e) {
+          if (_array[e].check < 0 && ++b.num == (bi ? 1 : 2)) b.ehead = e; // root (check = -1) is counted but not in the ring
+          _set_empty (e, e && _array[e].check < 0);
+        }
+        // block 0 stays Full as after _initialize (); it is never transferred, so its ehead would go stale
+        index_type& head_out = ! bi || b.num == 0 ? _bheadF : (b.num == 1 ? _bheadC : _bheadO);
         _push_block (bi, head_out, ! head_out && b.num);
       }
     }
+    // node to which a key is associated; the terminal (label 0) or a node w/ tail
+    bool _is_leaf (const index_type to) const {
+      const node& n = _array[to];
+      return n.check >= 0 && (_array[n.check].base == to || n.base < 0);
+    }
+    static int _popcount (uint64_t x) {
+#ifdef __GNUC__
+      return __builtin_popcountll (x);
+#else
+      int n = 0; for (; x; x &= x - 1) ++n; return n;
 #endif
+    }
+    // # trailing zeros; x != 0
+    static size_t _ctz (uint64_t x) {
+#ifdef __GNUC__
+      return static_cast <size_t> (__builtin_ctzll (x));
+#else
+      size_t n = 0; for (; ! (x & 1); x >>= 1) ++n; return n;
+#endif
+    }
+    // whether from may have children (not a terminal nor a node with tail)
+    bool _has_child (const size_t from) const
+    { return ! from || (_array[_array[from].check].base != static_cast <index_type> (from) && _array[from].base >= 0); }
+    // occupancy of the array being built by relayout ()
+    struct _layout {
+      uint64_t* used;  // bitmap
+      short*    nfree; // # empty elements in a block
+      size_t*   next;  // next block that may have an empty element (union-find)
+      size_t    num_blocks;
+      explicit _layout (const size_t num_blocks_) : used (0), nfree (0), next (0), num_blocks (0)
+      { while (num_blocks < (num_blocks_ ? num_blocks_ : 1)) _add_block (); }
+      ~_layout () { std::free (used); std::free (nfree); std::free (next); }
+      bool used_at (const size_t e) const { return (used[e >> 6] >> (e & 63)) & 1; }
+      void use (const size_t e) {
+        used[e >> 6] |= static_cast <uint64_t> (1) << (e & 63);
+        if (! --nfree[e >> 8]) next[e >> 8] = (e >> 8) + 1;
+      }
+      // base to put labels at empty elements; searched from start
+      size_t find (const uchar* label, const short k, const size_t start) {
+        for (size_t bi = _next (start >> 8); ; bi = _next (bi + 1)) {
+          if (nfree[bi] < k) continue;
+          const uint64_t* const u = &used[bi << 2];
+          for (size_t w = bi == start >> 8 ? (start & 0xff) >> 6 : 0; w < 4; ++w) {
+            uint64_t e = ~u[w];
+            if (bi == start >> 8 && w == (start & 0xff) >> 6) e &= ~static_cast <uint64_t> (0) << (start & 63);
+            for (; e; e &= e - 1) {
+              const size_t base = ((bi << 8) | (w << 6) | _ctz (e)) ^ label[0];
+              if (base < 256) continue; // block 0 is for the root and its children; the root (check = -1) looks empty
+              short j = 1;
+              while (j < k && ! used_at (base ^ label[j])) ++j;
+              if (j == k) return base;
+            }
+          }
+        }
+      }
+    private:
+      _layout (const _layout&);
+      _layout& operator= (const _layout&);
+      size_t _next (const size_t bi) {
+        size_t r = bi;
+        while (r < num_blocks && next[r] != r) r = next[r];
+        if (r == num_blocks) _add_block ();
+        for (size_t x = bi; x != r; ) { const size_t y = next[x]; next[x] = r; x = y; } // compress
+        return r;
+      }
+      void _add_block () {
+        _realloc_array (used,  static_cast <index_type> ((num_blocks + 1) << 2), static_cast <index_type> (num_blocks << 2));
+        _realloc_array (nfree, static_cast <index_type> (num_blocks + 1), static_cast <index_type> (num_blocks));
+        _realloc_array (next,  static_cast <index_type> (num_blocks + 1), static_cast <index_type> (num_blocks));
+        nfree[num_blocks] = 256;
+        next[num_blocks] = num_blocks;
+        ++num_blocks;
+      }
+    };
+    struct _weight_counter {
+      size_t* weight;
+      void operator () (const size_t to) { ++weight[to]; }
+    };
+    // # leaves before to
+    index_type _rank_leaf (const index_type to) const {
+      const rank_block& r = _rank[to >> 8];
+      index_type n = r.count;
+      for (int i = 0; i < ((to & 0xff) >> 6); ++i) n += _popcount (r.leaf[i]);
+      return n + _popcount (r.leaf[(to & 0xff) >> 6] & ((static_cast <uint64_t> (1) << (to & 63)) - 1));
+    }
+    // id-th leaf; binary search for the last block with count <= id, then select in its bitmap
+    index_type _select_leaf (index_type id) const {
+      index_type lo (0), hi (_size >> 8);
+      while (hi - lo > 1) {
+        const index_type mid = (lo + hi) >> 1;
+        if (_rank[mid].count <= id) lo = mid; else hi = mid;
+      }
+      id -= _rank[lo].count;
+      int i = 0;
+      for (int n; id >= (n = _popcount (_rank[lo].leaf[i])); ++i) id -= n;
+      uint64_t x = _rank[lo].leaf[i];
+      while (id--) x &= x - 1;
+      int b = 0;
+      for (; ! (x & 1); x >>= 1) ++b;
+      return (lo << 8) | (i << 6) | b;
+    }
+    // follow/create the terminal of a key that ends at from
+    template <typename T>
+    index_type _follow_terminal (npos_t& from, T& cf, bool& inserted) {
+      const index_type base = _array[from].base;
+      inserted = _array[base ^ 0].check != static_cast <index_type> (from);
+      if (inserted) ++_num_keys;
+      return _follow (from, 0, cf);
+    }
+    // records on tail for shrink_tail (true), ordered by their reversed bytes
+    struct _tail_record { index_type offset; int len; int head; index_type to; }; // head: bytes before the suffix
+    struct _tail_record_less {
+      const char* tail;
+      bool operator () (const _tail_record& a, const _tail_record& b) const {
+        const char* p = tail + a.offset + a.len, * q = tail + b.offset + b.len;
+        for (int i = a.len < b.len ? a.len : b.len; i; --i)
+          if (*--p != *--q) return static_cast <uchar> (*p) < static_cast <uchar> (*q);
+        return a.len < b.len;
+      }
+    };
+    // returns a new tail where a record that ends the next one in the order is put in it
+    char* _share_tail () {
+      index_type num = 0;
+      for (index_type to = 0; to < _size; ++to)
+        if (_on_tail (to)) ++num;
+      _tail_record* r = 0;
+      _realloc_array (r, num ? num : 1);
+      num = 0;
+      for (index_type to = 0; to < _size; ++to) {
+        const node& n = _array[to];
+        if (_on_tail (to)) {
+          const size_t len = _tail_len (&_tail[-n.base]);
+          const int head = static_cast <int> (_tail_head (len));
+          const _tail_record r_ = { -n.base - head, static_cast <int> (_tail_size (len)), head, to };
+          r[num++] = r_;
+        }
+      }
+      const _tail_record_less less = { _tail };
+      std::sort (r, r + num, less);
+      union { char* tail; index_type* length; } t;
+      size_t length_ = sizeof (index_type);
+      for (index_type i = num - 1; i >= 0; --i) // merged records take no room
+        if (i + 1 == num || ! _is_record_end (r[i], r[i + 1])) length_ += static_cast <size_t> (r[i].len);
+      t.tail = static_cast <char*> (std::malloc (length_));
+      if (! t.tail) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      *t.length = static_cast <index_type> (sizeof (index_type));
+      for (index_type i = num - 1; i >= 0; --i) {
+        index_type& base = _array[r[i].to].base;
+        if (i + 1 < num && _is_record_end (r[i], r[i + 1])) {
+          base = _array[r[i + 1].to].base - (r[i + 1].len - r[i].len) + (r[i + 1].head - r[i].head);
+        } else {
+          std::memcpy (&t.tail[*t.length], &_tail[r[i].offset], static_cast <size_t> (r[i].len));
+          base = - (*t.length + r[i].head);
+          *t.length += r[i].len;
+        }
+      }
+      std::free (r);
+      return t.tail;
+    }
+    // a is the end of b
+    bool _is_record_end (const _tail_record& a, const _tail_record& b) const {
+      return a.len <= b.len
+        && std::memcmp (&_tail[a.offset], &_tail[b.offset + b.len - a.len], static_cast <size_t> (a.len)) == 0;
+    }
+    // value of a leaf; on the node for a terminal, otherwise after the string on tail
+    value_type& _leaf_value (const index_type to) {
+      node& n = _array[to];
+      if (_array[n.check].base == to) return n.value;
+      char* const tail = &_tail[-n.base];
+      return _tail_value (tail, _tail_len (tail));
+    }
+    // append a record of [varint size][data] to the payload store
+    size_t _append_payload (const void* data, const size_t size) {
+      if (_payload_no_delete) { // copy on write
+        char* payload = 0;
+        _realloc_array (payload, static_cast <index_type> (_payload_size));
+        std::memcpy (payload, _payload, _payload_size);
+        _payload = payload;
+        _payload_no_delete = false;
+      }
+      if (_payload_quota < _payload_size + size + 10) {
+        const size_t quota = _payload_quota + _payload_quota;
+        _payload_quota = quota >= _payload_size + size + 10 ? quota : _payload_size + size + 10;
+        _realloc_array (_payload, static_cast <index_type> (_payload_quota), static_cast <index_type> (_payload_size));
+      }
+      const size_t offset = _payload_size;
+      size_t n = size;
+      do _payload[_payload_size++] = static_cast <char> ((n & 0x7f) | (n >> 7 ? 0x80 : 0)); while (n >>= 7);
+      std::memcpy (&_payload[_payload_size], data, size);
+      _payload_size += size;
+      return offset;
+    }
+    payload_type _read_payload (const size_t offset) const {
+      const uchar* p = reinterpret_cast <const uchar*> (&_payload[offset]);
+      size_t size = 0;
+      for (size_t shift = 0; ; shift += 7, ++p) {
+        size |= static_cast <size_t> (*p & 0x7f) << shift;
+        if (! (*p & 0x80)) break;
+      }
+      payload_type r = { reinterpret_cast <const char*> (p + 1), size };
+      return r;
+    }
+    // <fn>.hdr, written by save () next to the array so that the array file stays what older versions read:
+    // a header, followed by the label map (256 bytes) if flags & 1. open () counts the keys by scan if the file
+    // is missing, or stale (size differs) after the array was saved by an older version
+    struct header {
+      char     magic[4]; // "cdpp"
+      uint32_t version;  // 1
+      uint32_t flags;    // 2: tail is shared
+      uint32_t reserved;
+      uint64_t size;     // # nodes in the array
+      uint64_t num_keys;
+      uint64_t nonzero_size;
+      uint64_t nonzero_length;
+    };
+    int _save_header (const char* fn, const char* mode) const {
+      const char* const hdr = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".hdr");
+      FILE* fp = std::fopen (hdr, mode);
+      delete [] hdr;
+      if (! fp) return -1;
+      const header h = { { 'c', 'd', 'p', 'p' }, 1, (_remapped ? 1u : 0u) | (_tail_shared ? 2u : 0u), 0,
+                         static_cast <uint64_t> (_size), static_cast <uint64_t> (_num_keys),
+                         static_cast <uint64_t> (_nonzero_size), static_cast <uint64_t> (_nonzero_length) };
+      std::fwrite (&h, sizeof (header), 1, fp);
+      if (_remapped) std::fwrite (_code, sizeof (uchar), 256, fp);
+      std::fclose (fp);
+      return 0;
+    }
+    int _open_header (const char* fn, const char* mode) {
+      const char* const hdr = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".hdr");
+      FILE* fp = std::fopen (hdr, mode);
+      delete [] hdr;
+      header h;
+      uchar code[256];
+      bool fresh = false;
+      if (fp) {
+        const bool read = std::fread (&h, sizeof (header), 1, fp) == 1 && ! std::memcmp (h.magic, "cdpp", 4) && h.version == 1
+          && (! (h.flags & 1) || std::fread (code, sizeof (uchar), 256, fp) == 256);
+        std::fclose (fp);
+        if (! read) return -1;
+        fresh = h.size == static_cast <uint64_t> (_size);
+      }
+      _set_counter (fresh ? &h : 0);
+      if (fresh && (h.flags & 1)) _set_label_map (code);
+      return 0;
+    }
+    int _open_payload (const char* fn, const char* mode) {
+      const char* const pld
+        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".pld");
+      FILE* fp = std::fopen (pld, mode);
+      delete [] pld;
+      if (! fp) return 0; // no payload
+      const long end = std::fseek (fp, 0, SEEK_END) == 0 ? std::ftell (fp) : -1;
+      if (end < 0 || std::fseek (fp, 0, SEEK_SET) != 0) { std::fclose (fp); return -1; }
+      const size_t size = static_cast <size_t> (end);
+      _realloc_array (_payload, static_cast <index_type> (size));
+      const bool read = size == std::fread (_payload, sizeof (char), size, fp);
+      std::fclose (fp);
+      if (! read) return -1;
+      _payload_size = _payload_quota = size;
+      return 0;
+    }
+    // handles
+    int _hash_slot (const index_type from) const
+    { return static_cast <int> ((static_cast <uint64_t> (from) * 0x9e3779b97f4a7c15ULL) >> 32) & (_hslot_size - 1); }
+    int _find_slot (const index_type from) const { // slot of from or an empty slot to put it
+      int i = _hash_slot (from);
+      while (_hslot[i].head >= 0 && _hslot[i].node != from) i = (i + 1) & (_hslot_size - 1);
+      return i;
+    }
+    void _erase_slot (int i) { // backward shift deletion
+      for (int j = i; ; ) {
+        _hslot[i].head = -1;
+        for (;;) {
+          j = (j + 1) & (_hslot_size - 1);
+          if (_hslot[j].head < 0) { --_hslot_used; return; }
+          const int k = _hash_slot (_hslot[j].node);
+          if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) break; // j may fill i
+        }
+        _hslot[i] = _hslot[j];
+        i = j;
+      }
+    }
+    void _rehash_handles (const int n) {
+      handle_slot* const hslot = _hslot;
+      const int size = _hslot_size;
+      _hslot = 0;
+      _realloc_array (_hslot, n);
+      _hslot_size = n;
+      for (int i = 0; i < size; ++i)
+        if (hslot[i].head >= 0) _hslot[_find_slot (hslot[i].node)] = hslot[i];
+      std::free (hslot);
+    }
+    void _link_handle (const int h) { // handles are keyed by node; those on tail by the node owning the tail
+      if ((_hslot_used + 1) * 2 > _hslot_size) _rehash_handles (_hslot_size ? _hslot_size << 1 : 16);
+      const index_type from = static_cast <index_type> (_handle[h].node & TAIL_OFFSET_MASK);
+      handle_slot& s = _hslot[_find_slot (from)];
+      _handle[h].prev = -1;
+      if (s.head < 0) {
+        s.node = from;
+        _handle[h].next = -1;
+        ++_hslot_used;
+      } else {
+        _handle[h].next = s.head;
+        _handle[s.head].prev = h;
+      }
+      s.head = h;
+    }
+    void _unlink_handle (const int h) {
+      const handle_rec& r = _handle[h];
+      if (r.next >= 0) _handle[r.next].prev = r.prev;
+      if (r.prev >= 0) _handle[r.prev].next = r.next;
+      else {
+        const int i = _find_slot (static_cast <index_type> (r.node & TAIL_OFFSET_MASK));
+        if (r.next >= 0) _hslot[i].head = r.next; else _erase_slot (i);
+      }
+    }
+    void _relink_handles () { // after node ids changed wholesale
+      for (int i = 0; i < _hslot_size; ++i) _hslot[i] = handle_slot ();
+      _hslot_used = 0;
+      for (int h = 0; h < _handle_size; ++h)
+        if (_handle[h].prev != -2) _link_handle (h);
+    }
+    void _move_handles (const index_type to_, const index_type to) { // handles on to_ go to to, keeping their offsets on tail
+      const int i = _find_slot (to_);
+      const int head = _hslot[i].head;
+      if (head < 0) return;
+      _erase_slot (i);
+      int last = head;
+      for (int h = head; h >= 0; h = _handle[h].next)
+        _handle[last = h].node = (_handle[h].node & NODE_INDEX_MASK) | static_cast <npos_t> (to);
+      handle_slot& s = _hslot[_find_slot (to)];
+      if (s.head < 0) {
+        s.node = to;
+        ++_hslot_used;
+      } else { // stale handles on to (e.g., an erased key)
+        _handle[last].next = s.head;
+        _handle[s.head].prev = last;
+      }
+      s.head = head;
+    }
+    int _detach_tail_handles (const npos_t from) { // unlink handles on the tail of from into a list
+      int pending = -1;
+      for (int h = _hslot[_find_slot (static_cast <index_type> (from))].head, next; h >= 0; h = next) {
+        next = _handle[h].next;
+        if (_handle[h].node >> TAIL_OFFSET_SHIFT) {
+          _unlink_handle (h);
+          _handle[h].prev = -1;
+          _handle[h].next = pending;
+          pending = h;
+        }
+      }
+      return pending;
+    }
+    // link detached handles at position k on tail to the node; k = 0 links the rest as handles on the tail of
+    // the node, whose record starts skip bytes later than the one they have been read on
+    void _settle_handles (int& pending, const npos_t k, const npos_t to, const npos_t skip = 0) {
+      for (int* p = &pending; *p >= 0; ) {
+        const int h = *p;
+        if (k && _handle[h].node >> TAIL_OFFSET_SHIFT != k) { p = &_handle[h].next; continue; }
+        *p = _handle[h].next;
+        npos_t& from = _handle[h].node;
+        const npos_t k_ = (from >> TAIL_OFFSET_SHIFT) - skip;
+        if (k || k_ == 1) // the head of a tail is the node itself
+          from = to;
+        else
+          from = to | k_ << TAIL_OFFSET_SHIFT;
+        _link_handle (h);
+      }
+    }
+    void _clear_payload () {
+      if (_payload && ! _payload_no_delete) std::free (_payload);
+      _payload = 0;
+      _payload_size = _payload_quota = 0;
+      _payload_no_delete = false;
+    }
+    void _set_label_map (const uchar* code) {
+      _remapped = false;
+      _code[0] = _decode[0] = 0; // terminal
+      for (size_t c = 1; c < 256; ++c) _decode[c] = 0;
+      for (size_t c = 1; c < 256; ++c) {
+        const uchar l = code ? code[c] : static_cast <uchar> (c);
+        if (! l || _decode[l]) _err (__FILE__, __LINE__, "label map is not a permutation of 1..255\n");
+        _code[c] = l;
+        _decode[l] = static_cast <uchar> (c);
+        if (l != c) _remapped = true;
+      }
+    }
+    // take counters from the header saved with the array, or count them for an old file
+    void _set_counter (const header* h) {
+      _num_keys       = h ? static_cast <index_type> (h->num_keys)       : static_cast <index_type> (num_keys_by_scan ());
+      _nonzero_size   = h ? static_cast <index_type> (h->nonzero_size)   : static_cast <index_type> (nonzero_size_by_scan ());
+      _tail_shared    = h && (h->flags & 2);
+      _nonzero_length = h ? static_cast <index_type> (h->nonzero_length) : static_cast <index_type> (nonzero_length_by_scan ());
+    }
     void _set_result (result_type* x, value_type r, size_t = 0, npos_t = 0) const
     { *x = r; }
     void _set_result (result_pair_type* x, value_type r, size_t l, npos_t = 0) const
     { x->value = r; x->length = l; }
     void _set_result (result_triple_type* x, value_type r, size_t l, npos_t from) const
     { x->value = r; x->length = l; x->id = from; }
-    void _pop_block (const int bi, int& head_in, const bool last) {
+    void _pop_block (const index_type bi, index_type& head_in, const bool last) {
       if (last) { // last one poped; Closed or Open
         head_in = 0;
       } else {
@@ -686,18 +2431,18 @@ namespace cedar {
         if (bi == head_in) head_in = b.next;
       }
     }
-    void _push_block (const int bi, int& head_out, const bool empty) {
+    void _push_block (const index_type bi, index_type& head_out, const bool empty) {
       block& b = _block[bi];
       if (empty) { // the destination is empty
         head_out = b.prev = b.next = bi;
       } else { // use most recently pushed
-        int& tail_out = _block[head_out].prev;
+        index_type& tail_out = _block[head_out].prev;
         b.prev = tail_out;
         b.next = head_out;
         head_out = tail_out = _block[tail_out].next = bi;
       }
     }
-    int _add_block () {
+    index_type _add_block () {
       if (_size == _capacity) { // allocate memory if needed
 #ifdef USE_EXACT_FIT
         _capacity += _size >= MAX_ALLOC_SIZE ? MAX_ALLOC_SIZE : _size;
@@ -705,12 +2450,14 @@ namespace cedar {
         _capacity += _capacity;
 #endif
         _realloc_array (_array, _capacity, _capacity);
+#ifndef USE_COLOCATED_NINFO
         _realloc_array (_ninfo, _capacity, _size);
+#endif
         _realloc_array (_block, _capacity >> 8, _size >> 8);
       }
       _block[_size >> 8].ehead = _size;
       _array[_size] = node (- (_size + 255),  - (_size + 1));
-      for (int i = _size + 1; i < _size + 255; ++i)
+      for (index_type i = _size + 1; i < _size + 255; ++i)
         _array[i] = node (-(i - 1), -(i + 1));
       _array[_size + 255] = node (- (_size + 254),  -_size);
       _push_block (_size >> 8, _bheadO, ! _bheadO); // append to block Open
@@ -718,16 +2465,18 @@ namespace cedar {
       return (_size >> 8) - 1;
     }
     // transfer block from one start w/ head_in to one start w/ head_out
-    void _transfer_block (const int bi, int& head_in, int& head_out) {
+    void _transfer_block (const index_type bi, index_type& head_in, index_type& head_out) {
       _pop_block  (bi, head_in, bi == _block[bi].next);
       _push_block (bi, head_out, ! head_out && _block[bi].num);
     }
     // pop empty node from block; never transfer the special block (bi = 0)
-    int _pop_enode (const int base, const uchar label, const int from) {
-      const int e  = base < 0 ? _find_place () : base ^ label;
-      const int bi = e >> 8;
+    index_type _pop_enode (const index_type base, const uchar label, const index_type from) {
+      const index_type e  = base < 0 ? _find_place () : base ^ label;
+      ++_nonzero_size;
+      const index_type bi = e >> 8;
       node&  n = _array[e];
       block& b = _block[bi];
+      _set_empty (e, false);
       if (--b.num == 0) {
         if (bi) _transfer_block (bi, _bheadC, _bheadF); // Closed to Full
       } else { // release empty node from empty ring
@@ -738,21 +2487,22 @@ namespace cedar {
           _transfer_block (bi, _bheadO, _bheadC);
       }
       // initialize the released node
-      if (label) n.base = -1; else n.value = value_type (0); n.check = from;
+      if (label) n.base = -1; else n.base = 0, n.value = value_type (0); n.check = from;
       if (base < 0) _array[from].base = e ^ label;
       return e;
     }
     // push empty node into empty ring
-    void _push_enode (const int e) {
-      const int bi = e >> 8;
+    void _push_enode (const index_type e) {
+      const index_type bi = e >> 8;
+      --_nonzero_size;
       block& b = _block[bi];
-      if (++b.num == 1) { // Full to Closed
+      if (++b.num == (bi ? 1 : 2)) { // Full to Closed (block 0 also counts the root)
         b.ehead = e;
         _array[e] = node (-e, -e);
         if (bi) _transfer_block (bi, _bheadF, _bheadC); // Full to Closed
       } else {
-        const int prev = b.ehead;
-        const int next = -_array[prev].check;
+        const index_type prev = b.ehead;
+        const index_type next = -_array[prev].check;
         _array[e] = node (-prev, -next);
         _array[prev].check = _array[next].base = -e;
         if (b.num == 2 || b.trial == MAX_TRIAL) // Closed to Open
@@ -760,59 +2510,66 @@ namespace cedar {
         b.trial = 0;
       }
       if (b.reject < _reject[b.num]) b.reject = _reject[b.num];
-      _ninfo[e] = ninfo (); // reset ninfo; no child, no sibling
+      _set_empty (e, true);
+      _info (e) = ninfo (); // reset ninfo; no child, no sibling
     }
     // push label to from's child
-    void _push_sibling (const npos_t from, const int base, const uchar label, const bool flag = true) {
-      uchar* c = &_ninfo[from].child;
+    void _push_sibling (const npos_t from, const index_type base, const uchar label, const bool flag = true) {
+      uchar* c = &_info (from).child;
       if (flag && (ORDERED ? label > *c : ! *c))
-        do c = &_ninfo[base ^ *c].sibling; while (ORDERED && *c && *c < label);
-      _ninfo[base ^ label].sibling = *c, *c = label;
+        do c = &_info (base ^ *c).sibling; while (ORDERED && *c && *c < label);
+      _info (base ^ label).sibling = *c, *c = label;
     }
     // pop label from from's child
-    void _pop_sibling (const npos_t from, const int base, const uchar label) {
-      uchar* c = &_ninfo[from].child;
-      while (*c != label) c = &_ninfo[base ^ *c].sibling;
-      *c = _ninfo[base ^ label].sibling;
+    void _pop_sibling (const npos_t from, const index_type base, const uchar label) {
+      uchar* c = &_info (from).child;
+      while (*c != label) c = &_info (base ^ *c).sibling;
+      *c = _info (base ^ label).sibling;
     }
     // check whether to replace branching w/ the newly added node
-    bool _consult (const int base_n, const int base_p, uchar c_n, uchar c_p) const {
-      do c_n = _ninfo[base_n ^ c_n].sibling, c_p = _ninfo[base_p ^ c_p].sibling;
+    bool _consult (const index_type base_n, const index_type base_p, uchar c_n, uchar c_p) const {
+      do c_n = _info (base_n ^ c_n).sibling, c_p = _info (base_p ^ c_p).sibling;
       while (c_n && c_p);
       return c_p;
     }
     // enumerate (equal to or more than one) child nodes
-    uchar* _set_child (uchar* p, const int base, uchar c, const int label = -1) {
+    uchar* _set_child (uchar* p, const index_type base, uchar c, const int label = -1) {
       --p;
-      if (! c)  { *++p = c; c = _ninfo[base ^ c].sibling; } // 0: terminal
+      if (! c)  { *++p = c; c = _info (base ^ c).sibling; } // 0: terminal
       if (ORDERED)
-        while (c && c < label) { *++p = c; c = _ninfo[base ^ c].sibling; }
+        while (c && c < label) { *++p = c; c = _info (base ^ c).sibling; }
       if (label != -1) *++p = static_cast <uchar> (label);
-      while (c) { *++p = c; c = _ninfo[base ^ c].sibling; }
+      while (c) { *++p = c; c = _info (base ^ c).sibling; }
       return p;
     }
     // explore new block to settle down
-    int _find_place () {
+    index_type _find_place () {
       if (_bheadC) return _block[_bheadC].ehead;
       if (_bheadO) return _block[_bheadO].ehead;
       return _add_block () << 8;
     }
-    int _find_place (const uchar* const first, const uchar* const last) {
-      if (int bi = _bheadO) {
-        const int   bz = _block[_bheadO].prev;
+    index_type _find_place (const uchar* const first, const uchar* const last) {
+      if (index_type bi = _bheadO) {
+        const index_type bz = _block[_bheadO].prev;
         const short nc = static_cast <short> (last - first + 1);
         while (1) { // set candidate block
           block& b = _block[bi];
-          if (b.num >= nc && nc < b.reject) // explore configuration
-            for (int e = b.ehead;;) {
-              const int base = e ^ *first;
+          if (b.num >= nc && nc < b.reject) { // explore configuration
+#ifdef USE_RING_FIND_PLACE
+            for (index_type e = b.ehead;;) {
+              const index_type base = e ^ *first;
               for (const uchar* p = first; _array[base ^ *++p].check < 0; )
                 if (p == last) return b.ehead = e; // no conflict
               if ((e = -_array[e].check) == b.ehead) break;
             }
+#else
+            const index_type e = _find_empty (bi, first, last);
+            if (e >= 0) return b.ehead = e; // no conflict
+#endif
+          }
           b.reject = nc;
           if (b.reject < _reject[b.num]) _reject[b.num] = b.reject;
-          const int bi_ = b.next;
+          const index_type bi_ = b.next;
           if (++b.trial == MAX_TRIAL) _transfer_block (bi, _bheadO, _bheadC);
           if (bi == bz) break;
           bi = bi_;
@@ -820,73 +2577,144 @@ namespace cedar {
       }
       return _add_block () << 8;
     }
+#ifndef USE_RING_FIND_PLACE
+    // first empty element e in block bi (from ehead) such that e ^ *first ^ *p is empty for all p in [first, last]; -1 if none
+    index_type _find_empty (const index_type bi, const uchar* const first, const uchar* const last) const {
+      const block& b = _block[bi];
+      const size_t h = static_cast <size_t> (b.ehead) & 0xff;
+#ifdef __AVX2__
+      const __m256i empty = _mm256_loadu_si256 (reinterpret_cast <const __m256i*> (b.empty));
+      __m256i m = empty;
+      for (const uchar* p = first; p != last; ) {
+        m = _mm256_and_si256 (m, _xor_index (empty, *first ^ *++p)); // empty[e ^ (*first ^ *p)]
+        if (_mm256_testz_si256 (m, m)) return -1;
+      }
+      uint64_t c[4];
+      _mm256_storeu_si256 (reinterpret_cast <__m256i*> (c), m);
+      for (size_t i = 0; i <= 4; ++i) { // from ehead, wrapping around
+        const size_t w = ((h >> 6) + i) & 3;
+        const uint64_t x = i ? c[w] : c[w] & (~static_cast <uint64_t> (0) << (h & 63));
+        if (x) return (bi << 8) | static_cast <index_type> ((w << 6) | _ctz (x));
+      }
+#else // test each empty element from ehead as the ring walk does, but on the bitmap
+      for (size_t i = 0; i <= 4; ++i) {
+        const size_t w = ((h >> 6) + i) & 3;
+        for (uint64_t x = i ? b.empty[w] : b.empty[w] & (~static_cast <uint64_t> (0) << (h & 63)); x; x &= x - 1) {
+          const size_t base = ((w << 6) | _ctz (x)) ^ *first;
+          const uchar* p = first;
+          while (p != last && (b.empty[(base ^ p[1]) >> 6] >> ((base ^ p[1]) & 63) & 1)) ++p;
+          if (p == last) return (bi << 8) | static_cast <index_type> (base ^ *first);
+        }
+      }
+#endif
+      return -1;
+    }
+#ifdef __AVX2__
+    // element i of the result is element (i ^ d) of the 256-bit x
+    static __m256i _xor_index (const __m256i x, const uchar d) {
+      // bit k of a byte -> bit (k ^ (d & 7)) for the lower and upper half bytes
+#define CEDAR_BIT(n, k, d) ((((n) >> (k)) & 1) << (((k) ^ (d)) & 7))
+#define CEDAR_NIBBLE(n, o, d) static_cast <char> (CEDAR_BIT (n, o, d) | CEDAR_BIT (n, o + 1, d) | CEDAR_BIT (n, o + 2, d) | CEDAR_BIT (n, o + 3, d))
+#define CEDAR_ROW(o, d) { CEDAR_NIBBLE ( 0 << o, o, d), CEDAR_NIBBLE ( 1 << o, o, d), CEDAR_NIBBLE ( 2 << o, o, d), CEDAR_NIBBLE ( 3 << o, o, d), \
+                          CEDAR_NIBBLE ( 4 << o, o, d), CEDAR_NIBBLE ( 5 << o, o, d), CEDAR_NIBBLE ( 6 << o, o, d), CEDAR_NIBBLE ( 7 << o, o, d), \
+                          CEDAR_NIBBLE ( 8 << o, o, d), CEDAR_NIBBLE ( 9 << o, o, d), CEDAR_NIBBLE (10 << o, o, d), CEDAR_NIBBLE (11 << o, o, d), \
+                          CEDAR_NIBBLE (12 << o, o, d), CEDAR_NIBBLE (13 << o, o, d), CEDAR_NIBBLE (14 << o, o, d), CEDAR_NIBBLE (15 << o, o, d) }
+      static const char bit[2][8][16] = {
+        { CEDAR_ROW (0, 0), CEDAR_ROW (0, 1), CEDAR_ROW (0, 2), CEDAR_ROW (0, 3), CEDAR_ROW (0, 4), CEDAR_ROW (0, 5), CEDAR_ROW (0, 6), CEDAR_ROW (0, 7) },
+        { CEDAR_ROW (4, 0), CEDAR_ROW (4, 1), CEDAR_ROW (4, 2), CEDAR_ROW (4, 3), CEDAR_ROW (4, 4), CEDAR_ROW (4, 5), CEDAR_ROW (4, 6), CEDAR_ROW (4, 7) } };
+#undef CEDAR_ROW
+#undef CEDAR_NIBBLE
+#undef CEDAR_BIT
+      const __m256i dword = _mm256_xor_si256 (_mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32 ((d >> 6) << 1));
+      const __m256i byte  = _mm256_xor_si256 (_mm256_setr_epi8 (0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                                                0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                              _mm256_set1_epi8 (static_cast <char> ((d >> 3) & 7)));
+      const __m256i y  = _mm256_shuffle_epi8 (_mm256_permutevar8x32_epi32 (x, dword), byte); // word (d >> 6), byte (d >> 3)
+      const __m256i lo = _mm256_set1_epi8 (0x0f);
+      const __m256i t0 = _mm256_broadcastsi128_si256 (_mm_loadu_si128 (reinterpret_cast <const __m128i*> (bit[0][d & 7])));
+      const __m256i t1 = _mm256_broadcastsi128_si256 (_mm_loadu_si128 (reinterpret_cast <const __m128i*> (bit[1][d & 7])));
+      return _mm256_or_si256 (_mm256_shuffle_epi8 (t0, _mm256_and_si256 (y, lo)),
+                              _mm256_shuffle_epi8 (t1, _mm256_and_si256 (_mm256_srli_epi16 (y, 4), lo)));
+    }
+#endif
+#endif
+    // mark e in (or out of) the empty ring of its block
+    void _set_empty (const index_type e, const bool empty) {
+#ifndef USE_RING_FIND_PLACE
+      uint64_t& w = _block[e >> 8].empty[(e & 0xff) >> 6];
+      const uint64_t bit = static_cast <uint64_t> (1) << (e & 63);
+      if (empty) w |= bit; else w &= ~bit;
+#else
+      (void) e; (void) empty;
+#endif
+    }
     // resolve conflict on base_n ^ label_n = base_p ^ label_p
     template <typename T>
-    int _resolve (npos_t& from_n, const int base_n, const uchar label_n, T& cf) {
+    index_type _resolve (npos_t& from_n, const index_type base_n, const uchar label_n, T& cf) {
       // examine siblings of conflicted nodes
-      const int to_pn  = base_n ^ label_n;
-      const int from_p = _array[to_pn].check;
-      const int base_p = _array[from_p].base;
+      const index_type to_pn  = base_n ^ label_n;
+      const index_type from_p = _array[to_pn].check;
+      const index_type base_p = _array[from_p].base;
       const bool flag // whether to replace siblings of newly added
-        = _consult (base_n, base_p, _ninfo[from_n].child, _ninfo[from_p].child);
+        = _consult (base_n, base_p, _info (from_n).child, _info (from_p).child);
       uchar child[256];
       uchar* const first = &child[0];
       uchar* const last  =
-        flag ? _set_child (first, base_n, _ninfo[from_n].child, label_n)
-        : _set_child (first, base_p, _ninfo[from_p].child);
-      const int base =
+        flag ? _set_child (first, base_n, _info (from_n).child, label_n)
+        : _set_child (first, base_p, _info (from_p).child);
+      const index_type base =
         (first == last ? _find_place () : _find_place (first, last)) ^ *first;
       // replace & modify empty list
-      const int from  = flag ? static_cast <int> (from_n) : from_p;
-      const int base_ = flag ? base_n : base_p;
-      if (flag && *first == label_n) _ninfo[from].child = label_n; // new child
+      const index_type from  = flag ? static_cast <index_type> (from_n) : from_p;
+      const index_type base_ = flag ? base_n : base_p;
+      if (flag && *first == label_n) _info (from).child = label_n; // new child
       _array[from].base = base; // new base
       for (const uchar* p = first; p <= last; ++p) { // to_ => to
-        const int to  = _pop_enode (base, *p, from);
-        const int to_ = base_ ^ *p;
-        _ninfo[to].sibling = (p == last ? 0 : *(p + 1));
+        const index_type to  = _pop_enode (base, *p, from);
+        const index_type to_ = base_ ^ *p;
+        _info (to).sibling = (p == last ? 0 : *(p + 1));
         if (flag && to_ == to_pn) continue; // skip newcomer (no child)
         cf (to_, to); // user-defined callback function to handle moved nodes
         node& n  = _array[to];
         node& n_ = _array[to_];
         if ((n.base = n_.base) > 0 && *p) // copy base; bug fix
           {
-            uchar c = _ninfo[to].child = _ninfo[to_].child;
+            uchar c = _info (to).child = _info (to_).child;
             do _array[n.base ^ c].check = to; // adjust grand son's check
-            while ((c = _ninfo[n.base ^ c].sibling));
+            while ((c = _info (n.base ^ c).sibling));
           }
-        if (! flag && to_ == static_cast <int> (from_n)) // parent node moved
+        if (! flag && to_ == static_cast <index_type> (from_n)) // parent node moved
           from_n = static_cast <size_t> (to); // bug fix
         if (! flag && to_ == to_pn) { // the address is immediately used
           _push_sibling (from_n, to_pn ^ label_n, label_n);
-          _ninfo[to_].child = 0; // remember to reset child
-          if (label_n) n_.base = -1; else n_.value = value_type (0);
-          n_.check = static_cast <int> (from_n);
+          _info (to_).child = 0; // remember to reset child
+          if (label_n) n_.base = -1; else n_.base = 0, n_.value = value_type (0);
+          n_.check = static_cast <index_type> (from_n);
         } else
           _push_enode (to_);
-        if (NUM_TRACKING_NODES) // keep the traversed node updated
-          for (size_t j = 0; tracking_node[j] != 0; ++j) {
-            if (static_cast <int> (tracking_node[j] & TAIL_OFFSET_MASK) == to_) {
-              tracking_node[j] &= NODE_INDEX_MASK;
-              tracking_node[j] |= static_cast <npos_t> (to);
-            }
-          }
+        if (_num_handles) _move_handles (to_, to);
       }
       return flag ? base ^ label_n : to_pn;
     }
     // test the validity of double array for debug
     void _test (const npos_t from = 0) const {
-      const int base = _array[from].base;
+      const index_type base = _array[from].base;
       if (base < 0) { // validate tail offset
-        assert (*_length >= static_cast <int> (-base + 1 + sizeof (value_type)));
+        assert (*_length >= static_cast <index_type> (-base + TAIL_TERM + sizeof (value_type)));
         return;
       }
-      uchar c = _ninfo[from].child;
+      uchar c = _info (from).child;
       do {
-        if (from) assert (_array[base ^ c].check == static_cast <int> (from));
+        if (from) assert (_array[base ^ c].check == static_cast <index_type> (from));
         if (c) _test (static_cast <npos_t> (base ^ c));
-      } while ((c = _ninfo[base ^ c].sibling));
+      } while ((c = _info (base ^ c).sibling));
     }
   };
+  }
+  template <typename value_type_>
+  using prefix_trie = mp::da <value_type_>;
+#ifndef CEDAR_H
+  using mp::da;
+#endif
 }
 #endif
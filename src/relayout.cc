@@ -0,0 +1,132 @@
+// cedar -- C++ implementation of Efficiently-updatable Double ARray trie
+//  Relayout a trie for cache locality with a sample query log
+//
+//  % relayout trie queries trie.out
+//  Nodes read by the queries (one per line) come first; see da::relayout (). The output has the same keys and
+//  values as the input; the tool reports the average number of cache lines and pages touched per lookup.
+//  It then adds a key per query to both the output and the input tries and checks that they still agree.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef USE_PREFIX_TRIE
+#include <cedarpp.h>
+#else
+#include <cedar.h>
+#endif
+
+static const size_t CACHE_LINE_SIZE = 64;
+static const size_t PAGE_SIZE = 4096;
+
+#ifdef USE_PREFIX_TRIE
+typedef cedar::da <int>  trie_t; // same value type as mkcedar otherwise
+#else
+typedef cedar::da <long> trie_t;
+#endif
+
+// distinct cache lines and pages among the elements a lookup reads
+struct footprint {
+  size_t unit;
+  std::vector <size_t>* line;
+  std::vector <size_t>* page;
+  template <typename T>
+  void operator () (const T to) {
+    const size_t offset = static_cast <size_t> (to) * unit;
+    add (*line, offset / CACHE_LINE_SIZE);
+    add (*page, offset / PAGE_SIZE);
+  }
+  static void add (std::vector <size_t>& v, const size_t x) {
+    for (size_t i = 0; i < v.size (); ++i)
+      if (v[i] == x) return;
+    v.push_back (x);
+  }
+};
+
+static void report (const char* label, const trie_t& trie, const std::vector <const char*>& query, const std::vector <size_t>& len) {
+  std::vector <size_t> line, page;
+  footprint f = { trie.unit_size (), &line, &page };
+  size_t lines (0), pages (0);
+  for (size_t i = 0; i < query.size (); ++i) {
+    line.clear ();
+    page.clear ();
+    trie.pathVisit (query[i], len[i], f);
+    lines += line.size ();
+    pages += page.size ();
+  }
+  const double n = query.empty () ? 1.0 : static_cast <double> (query.size ());
+  std::fprintf (stderr, "%s: %.2f cache lines, %.2f pages per lookup (size: %ld)\n",
+                label, static_cast <double> (lines) / n, static_cast <double> (pages) / n, static_cast <long> (trie.size ()));
+}
+
+// every key of orig is in trie with the same value
+struct checker {
+  const trie_t* orig;
+  const trie_t* trie;
+  std::vector <char>* key;
+  size_t* num;
+  template <typename T>
+  bool operator () (const trie_t::result_type value, const size_t len, const T id) {
+    if (key->size () <= len) key->resize (len + 1);
+    orig->suffix (&(*key)[0], len, id);
+    if (trie->exactMatchSearch <trie_t::result_type> (&(*key)[0], len) != value) return false;
+    ++*num;
+    return true;
+  }
+};
+
+int main (int argc, char **argv) {
+  if (argc < 4)
+    { std::fprintf (stderr, "Usage: %s trie queries trie.out\n", argv[0]); std::exit (1); }
+  //
+  trie_t trie, orig;
+  if (trie.open (argv[1]) || orig.open (argv[1]))
+    { std::fprintf (stderr, "cannot open: %s\n", argv[1]); std::exit (1); }
+  FILE* fp = argv[2][0] == '-' ? stdin : std::fopen (argv[2], "r");
+  if (! fp)
+    { std::fprintf (stderr, "cannot open: %s\n", argv[2]); std::exit (1); }
+  std::vector <std::string> line_;
+  char line[8192];
+  while (std::fgets (line, 8192, fp)) {
+    size_t n = std::strlen (line);
+    if (n && line[n - 1] == '\n') --n; // the last line may have no newline
+    line_.push_back (std::string (line, n));
+  }
+  if (fp != stdin) std::fclose (fp);
+  std::vector <const char*> query;
+  std::vector <size_t> len;
+  for (size_t i = 0; i < line_.size (); ++i)
+    query.push_back (line_[i].c_str ()), len.push_back (line_[i].size ());
+  //
+  report ("before", trie, query, len);
+  trie.relayout (query.size (), query.empty () ? 0 : &query[0], query.empty () ? 0 : &len[0]);
+  report ("after", trie, query, len);
+  //
+  std::vector <char> key;
+  size_t num = 0;
+  checker c = { &orig, &trie, &key, &num };
+  orig.dumpVisit (c);
+  if (num != orig.num_keys () || trie.num_keys () != orig.num_keys ())
+    { std::fprintf (stderr, "relayout broke the trie\n"); std::exit (1); }
+  if (trie.save (argv[3]) != 0)
+    { std::fprintf (stderr, "cannot save trie: %s\n", argv[3]); std::exit (1); }
+  // the trie must stay updatable after relayout; add the same new keys to both and compare again
+  std::string key_;
+  for (size_t i = 0; i < query.size (); ++i) {
+    key_.assign (query[i], len[i]);
+    key_ += '\x01';
+    trie.update (key_.c_str (), key_.size (), static_cast <trie_t::result_type> (i));
+    orig.update (key_.c_str (), key_.size (), static_cast <trie_t::result_type> (i));
+  }
+  num = 0;
+  orig.dumpVisit (c);
+  if (num != orig.num_keys () || trie.num_keys () != orig.num_keys ())
+    { std::fprintf (stderr, "updates after relayout broke the trie\n"); std::exit (1); }
+  std::fprintf (stderr, "keys: %zu\n", trie.num_keys ());
+  return 0;
+}
@@ -7,6 +7,23 @@
 %include "std_vector.i"
 %template (vectorr) std::vector <result_t>;
 
+%exception trie::lookup_many {
+  try { $action }
+  catch (const char* msg) { SWIG_exception (SWIG_ValueError, msg); }
+}
+%exception trie::insert_many {
+  try { $action }
+  catch (const char* msg) { SWIG_exception (SWIG_ValueError, msg); }
+}
+%exception trie::erase_many {
+  try { $action }
+  catch (const char* msg) { SWIG_exception (SWIG_ValueError, msg); }
+}
+%exception trie::prefix_many {
+  try { $action }
+  catch (const char* msg) { SWIG_exception (SWIG_ValueError, msg); }
+}
+
 #ifdef SWIGPYTHON
 
 #ifdef SWIGPYTHON_BUILTIN
@@ -46,6 +63,77 @@
 %extend trie_iterator {
   trie_iterator __iter__ () { return *self; }
 }
+
+// batch predicates: keys (and values) from any object with the buffer protocol (bytes, bytearray,
+// mmap, array ('i'), ...) without copying or from str as UTF-8, and packed ints back as a memoryview
+// of format 'i'
+%{
+struct py_buffer_t { // released with the wrapper
+  Py_buffer view;
+  py_buffer_t () { view.obj = 0; }
+  ~py_buffer_t () { if (view.obj) PyBuffer_Release (&view); }
+};
+static int get_keys (PyObject* o, py_buffer_t& b) {
+#if PY_VERSION_HEX >= 0x03030000
+  if (PyUnicode_Check (o)) { // UTF-8 kept by o
+    b.view.buf = const_cast <char*> (PyUnicode_AsUTF8AndSize (o, &b.view.len));
+    return b.view.buf ? 0 : -1;
+  }
+#endif
+  return PyObject_GetBuffer (o, &b.view, PyBUF_SIMPLE);
+}
+static int get_values (PyObject* o, py_buffer_t& b) {
+  if (o == Py_None) return 0;
+  if (PyObject_GetBuffer (o, &b.view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0) return -1;
+  const char* f = b.view.format ? b.view.format : "B";
+  if (! ((b.view.itemsize == 1 || (b.view.itemsize == sizeof (int) && f[std::strlen (f) - 1] == 'i'))
+         && b.view.len % static_cast <Py_ssize_t> (sizeof (int)) == 0)) {
+    PyErr_SetString (PyExc_ValueError, "values must be packed ints");
+    return -1;
+  }
+  return 0;
+}
+static PyObject* from_values (const values_t& v) {
+  PyObject* bytes = PyByteArray_FromStringAndSize (v.empty () ? "" : reinterpret_cast <const char*> (&v[0]),
+                                                   static_cast <Py_ssize_t> (v.size () * sizeof (int)));
+  if (! bytes) return 0;
+#if PY_VERSION_HEX >= 0x03000000
+  PyObject* view = PyMemoryView_FromObject (bytes);
+  Py_DECREF (bytes);
+  if (! view) return 0;
+  PyObject* ints = PyObject_CallMethod (view, const_cast <char*> ("cast"), const_cast <char*> ("s"), "i");
+  Py_DECREF (view);
+  return ints;
+#else
+  return bytes;
+#endif
+}
+%}
+
+%typemap(in) (const char* keys, size_t size) (py_buffer_t buf) {
+  if (get_keys ($input, buf) != 0) SWIG_fail;
+  $1 = static_cast <const char*> (buf.view.buf);
+  $2 = static_cast <size_t> (buf.view.len);
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_STRING) (const char* keys, size_t size)
+{ $1 = PyObject_CheckBuffer ($input) || PyUnicode_Check ($input) ? 1 : 0; }
+%typemap(in) (const int* values, size_t num_values) (py_buffer_t buf) {
+  if (get_values ($input, buf) != 0) SWIG_fail;
+  $1 = buf.view.obj ? static_cast <const int*> (buf.view.buf) : 0;
+  $2 = buf.view.obj ? static_cast <size_t> (buf.view.len) / sizeof (int) : 0;
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_INT32_ARRAY) (const int* values, size_t num_values)
+{ $1 = $input == Py_None || PyObject_CheckBuffer ($input) ? 1 : 0; }
+%typemap(out) values_t {
+  $result = from_values (static_cast <const values_t&> ($1));
+  if (! $result) SWIG_fail;
+}
+#else
+// packed buffers are only mapped for Python
+%ignore trie::lookup_many;
+%ignore trie::insert_many;
+%ignore trie::erase_many;
+%ignore trie::prefix_many;
 #endif
 
 #ifdef SWIGRUBY
@@ -1,35 +1,58 @@
 #!/usr/bin/env python
-import sys, time, cedar
+from __future__ import print_function
+import sys, time, array, cedar
 
 trie = cedar.trie ()
 
 keys = queries = len (sys.argv) > 1 and sys.argv[1] or "/usr/share/dict/words"
 
-t = time.clock ()
+t = time.time ()
 n = 0
 for line in open (keys):
     n += 1
     trie[line[:-1]] = n
 #    trie.insert (line[:-1], n)
-print >> sys.stderr, "insert %f sec." % (time.clock () - t)
+print ("insert %f sec." % (time.time () - t), file=sys.stderr)
 
-t = time.clock ()
+t = time.time ()
 for line in open (queries):
     trie[line[:-1]]
 #    trie.lookup (line[:-1])
-print >> sys.stderr, "lookup %f sec." % (time.clock () - t)
+print ("lookup %f sec." % (time.time () - t), file=sys.stderr)
 
-t = time.clock ()
+t = time.time ()
 for r in trie.prefix ("cedar"):
-    print >> sys.stderr, r.value (), r.key ()
-print >> sys.stderr, "prefix %f sec." % (time.clock () - t)
+    print (r.value (), r.key (), file=sys.stderr)
+print ("prefix %f sec." % (time.time () - t), file=sys.stderr)
 
-t = time.clock ()
+t = time.time ()
 r = trie.longest_prefix ("cedarwoo")
-print >> sys.stderr, r.value (), r.key ()
-print >> sys.stderr, "longest prefix %f sec." % (time.clock () - t)
+print (r.value (), r.key (), file=sys.stderr)
+print ("longest prefix %f sec." % (time.time () - t), file=sys.stderr)
 
-t = time.clock ()
+t = time.time ()
 for r in trie.predict ("cedar"):
-    print >> sys.stderr, r.value (), r.key ()
-print >> sys.stderr, "predict %f sec." % (time.clock () - t)
+    print (r.value (), r.key (), file=sys.stderr)
+print ("predict %f sec." % (time.time () - t), file=sys.stderr)
+
+# batch predicates; newline-separated keys in, packed ints out
+data = open (keys, "rb").read ()
+n = data.count (b"\n")
+
+t = time.time ()
+trie.erase_many (data)
+print ("erase_many %f sec. (%d keys left)" % (time.time () - t, trie.num_keys ()), file=sys.stderr)
+
+t = time.time ()
+trie.insert_many (data, array.array ("i", range (1, n + 1)))
+print ("insert_many %f sec." % (time.time () - t), file=sys.stderr)
+
+t = time.time ()
+values = trie.lookup_many (open (queries, "rb").read ())
+print ("lookup_many %f sec. (%d found)" % (time.time () - t, sum (1 for v in values if v != -1)), file=sys.stderr)
+
+t = time.time ()
+r = trie.prefix_many (b"cedar\ncedarwood")
+for i in range (0, len (r), 3): # (key index, prefix length, value)
+    print (r[i], r[i + 1], r[i + 2], file=sys.stderr)
+print ("prefix_many %f sec." % (time.time () - t), file=sys.stderr)
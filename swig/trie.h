@@ -1,10 +1,53 @@
 #include <vector>
+#include <cstring>
+#include <stdint.h> //uint32_t
 // #include <cedar.h>
 // typedef size_t npos_t;
 #include <cedarpp.h>
 typedef cedar::npos_t npos_t;
 typedef cedar::da <int>  trie_t;
 
+// return type for the batch predicates; packed ints (a buffer in Python)
+typedef std::vector <int> values_t;
+
+// reader of packed keys for the batch predicates: keys separated by delim ('\n' by default; the last
+// one may be omitted), or, with delim = -1, each preceded by its length as a native uint32_t.
+// An empty key is reported but never matches; malformed input or a key with '\0', which cedar
+// cannot store, throws a message
+class key_reader {
+private:
+  const char*       _p;
+  const char* const _end;
+  const int         _delim;
+public:
+  key_reader (const char* keys, const size_t size, const int delim) : _p (keys), _end (keys + size), _delim (delim) {}
+  bool next (const char*& key, size_t& len) {
+    if (_p == _end) return false;
+    if (_delim < 0) {
+      uint32_t n = 0;
+      if (static_cast <size_t> (_end - _p) < sizeof (n)) throw "truncated key length";
+      std::memcpy (&n, _p, sizeof (n));
+      _p += sizeof (n);
+      if (static_cast <size_t> (_end - _p) < n) throw "truncated key";
+      key = _p; len = n; _p += n;
+    } else {
+      const char* q = static_cast <const char*> (std::memchr (_p, _delim, static_cast <size_t> (_end - _p)));
+      key = _p; len = static_cast <size_t> ((q ? q : _end) - _p);
+      _p = q ? q + 1 : _end;
+    }
+    if (std::memchr (key, '\0', len)) throw "key contains '\\0'";
+    return true;
+  }
+  // number of keys; throws before a batch update touches the trie
+  static size_t count (const char* keys, const size_t size, const int delim) {
+    key_reader r (keys, size, delim);
+    const char* key = 0;
+    size_t num (0), len (0);
+    while (r.next (key, len)) ++num;
+    return num;
+  }
+};
+
 // return type for prefix ()
 class result_t {
 public:
@@ -49,29 +92,79 @@ public:
 class trie {
 private:
   trie_t* _t;
-  size_t  _num_keys;
+  struct prefix_collector { // visitor for prefix_many ()
+    values_t& result;
+    const int i;
+    prefix_collector (values_t& result_, const int i_) : result (result_), i (i_) {}
+    bool operator () (const int value, const size_t len, const npos_t) {
+      result.push_back (i); result.push_back (static_cast <int> (len)); result.push_back (value);
+      return true;
+    }
+  };
 public:
-  trie  () : _t (new cedar::da <int> ()), _num_keys (0) {}
+  trie  () : _t (new cedar::da <int> ()) {}
   ~trie () { delete _t; }
   // read/write
   bool open (const char* fn) { return _t->open (fn, "rb") == 0; }
   bool save (const char* fn) { return _t->save (fn, "wb") == 0; }
   // get statistics
-  size_t num_keys () const { return _num_keys; } // O(1)
+  size_t num_keys () const { return _t->num_keys (); } // O(1)
   // low-level predicates
   int  insert (const char* key, int n = 0) {
-    npos_t from = 0;
-    size_t pos (0), len (std::strlen (key));
-    const int n_ = _t->traverse (key, from, pos, len);
-    bool flag = n_ == trie_t::CEDAR_NO_VALUE || n_ == trie_t::CEDAR_NO_PATH;
-    if (flag) ++_num_keys;
-    _t->update (key, from, pos, len) = n;
+    bool flag = false;
+    _t->update (key, std::strlen (key), 0, flag) = n;
     return flag ? 0 : -1;
   }
   int  erase  (const char* key)
-  { if (_t->erase (key)) return -1; else { --_num_keys; return 0; } }
+  { return _t->erase (key); }
   int  lookup (const char* key) const
   { return _t->exactMatchSearch <trie_t::result_type> (key); }
+  // batch predicates on packed keys (see key_reader); one call per buffer instead of per key
+  values_t lookup_many (const char* keys, size_t size, int delim = '\n') const { // values (or CEDAR_NO_VALUE)
+    values_t result;
+    result.reserve (size / 8);
+    trie_t::sorted_searcher s (*_t); // resumes at the common prefix with the previous key
+    key_reader r (keys, size, delim);
+    const char* key = 0;
+    for (size_t len = 0; r.next (key, len); )
+      result.push_back (len ? s.exactMatchSearch <trie_t::result_type> (key, len) : trie_t::CEDAR_NO_VALUE);
+    return result;
+  }
+  // set key i to values[i] (or 0 without values); returns the number of new keys
+  size_t insert_many (const char* keys, size_t size, const int* values, size_t num_values, int delim = '\n') {
+    if (key_reader::count (keys, size, delim) > num_values && values) throw "fewer values than keys";
+    trie_t::sorted_updater u (*_t);
+    trie_t::empty_callback cf;
+    key_reader r (keys, size, delim);
+    const char* key = 0;
+    size_t num (0), i (0);
+    for (size_t len = 0; r.next (key, len); ++i) {
+      if (! len) continue;
+      bool flag = false;
+      u.update (key, len, 0, cf, flag) = values ? values[i] : 0;
+      if (flag) ++num;
+    }
+    return num;
+  }
+  // returns the number of erased keys
+  size_t erase_many (const char* keys, size_t size, int delim = '\n') {
+    key_reader::count (keys, size, delim);
+    key_reader r (keys, size, delim);
+    const char* key = 0;
+    size_t num = 0;
+    for (size_t len = 0; r.next (key, len); )
+      if (len && _t->erase (key, len) == 0) ++num;
+    return num;
+  }
+  // (index of key, length of prefix, value) for each prefix of each key that is in the trie
+  values_t prefix_many (const char* keys, size_t size, int delim = '\n') const {
+    values_t result;
+    key_reader r (keys, size, delim);
+    const char* key = 0;
+    for (size_t len (0), i (0); r.next (key, len); ++i)
+      _t->commonPrefixVisit (key, len, prefix_collector (result, static_cast <int> (i)));
+    return result;
+  }
   // high-level (trie-specific) predicates
   std::vector <result_t> prefix (const char* key) const {
     std::vector <result_t> result;